@@ -7,9 +7,24 @@
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   Data normally moves through the data register a word at a
+   time (PIO).  With the "-dma" option, transfers to and from
+   kernel memory instead use the bus-master DMA engine of a PCI
+   IDE controller, such as the PIIX that QEMU emulates: the
+   controller copies the data itself, guided by a table of
+   physical memory regions (PRDs), and interrupts once at the
+   end.  PIO remains in use for buffers DMA cannot reach, for
+   controllers or disks that lack DMA, and on a channel whose
+   DMA transfer has failed. */
+
+/* If true, use bus-master DMA where possible.
+   Controlled by kernel command-line option "-dma". */
+bool disk_dma;
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -28,10 +43,26 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master port addresses, relative to a channel's BM_BASE. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0)    /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)     /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)       /* PRD table. */
+
+/* Bus master command and status register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+#define BM_STA_ERR 0x02         /* Transfer failed (write 1 to clear). */
+#define BM_STA_INTR 0x04        /* Disk interrupted (write 1 to clear). */
+
+/* PCI configuration space access. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -47,6 +78,22 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Physical region descriptor: one piece of memory taking part in
+   a bus-master transfer.  A region may not cross a 64 kB
+   boundary. */
+struct prd {
+	uint32_t addr;              /* Physical address. */
+	uint16_t size;              /* Size in bytes, 0 meaning 64 kB. */
+	uint16_t flags;             /* PRD_EOT on the last region. */
+};
+#define PRD_EOT 0x8000
+
+/* Number of PRDs per channel: enough for DISK_MULTIPLE_MAX
+   sectors, which span at most 3 64 kB boundaries. */
+#define PRD_CNT 4
 
 /* An ATA device. */
 struct disk {
@@ -56,6 +103,7 @@ struct disk {
 
 	bool is_ata;                /* 1=This device is an ATA disk. */
 	disk_sector_t capacity;     /* Capacity in sectors (if is_ata). */
+	bool dma;                   /* Supports DMA? */
 
 	long long read_cnt;         /* Number of sectors read. */
 	long long write_cnt;        /* Number of sectors written. */
@@ -73,6 +121,11 @@ struct channel {
 								   any interrupt would be spurious. */
 	struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+	uint16_t bm_base;           /* Bus master base port, or 0 if none. */
+	struct prd prdt[PRD_CNT]    /* PRD table; aligned so as not to */
+		__attribute__ ((aligned (sizeof (struct prd) * PRD_CNT)));
+	                            /* cross a 64 kB boundary. */
+
 	struct disk devices[2];     /* The devices on this channel. */
 };
 
@@ -84,7 +137,7 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
-static void select_sector (struct disk *, disk_sector_t);
+static void select_sector (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -96,9 +149,15 @@ static void select_device_wait (const struct disk *);
 
 static void interrupt_handler (struct intr_frame *);
 
+static uint16_t find_bus_master (void);
+static bool dma_usable (const struct disk *, const void *, size_t cnt);
+static bool dma_transfer (struct disk *, disk_sector_t, size_t cnt,
+		void *, bool write);
+
 /* Initialize the disk subsystem and detect disks. */
 void
 disk_init (void) {
+	uint16_t bm_base = disk_dma ? find_bus_master () : 0;
 	size_t chan_no;
 
 	for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
@@ -122,6 +181,7 @@ disk_init (void) {
 		lock_init (&c->lock);
 		c->expecting_interrupt = false;
 		sema_init (&c->completion_wait, 0);
+		c->bm_base = bm_base != 0 ? bm_base + chan_no * 8 : 0;
 
 		/* Initialize devices. */
 		for (dev_no = 0; dev_no < 2; dev_no++) {
@@ -132,6 +192,7 @@ disk_init (void) {
 
 			d->is_ata = false;
 			d->capacity = 0;
+			d->dma = false;
 
 			d->read_cnt = d->write_cnt = 0;
 		}
@@ -167,8 +228,9 @@ disk_print_stats (void) {
 		for (dev_no = 0; dev_no < 2; dev_no++) {
 			struct disk *d = disk_get (chan_no, dev_no);
 			if (d != NULL && d->is_ata)
-				printf ("%s: %lld reads, %lld writes\n",
-						d->name, d->read_cnt, d->write_cnt);
+				printf ("%s: %lld reads, %lld writes%s\n",
+						d->name, d->read_cnt, d->write_cnt,
+						d->dma && d->channel->bm_base != 0 ? " (DMA)" : "");
 		}
 	}
 }
@@ -209,47 +271,108 @@ disk_size (struct disk *d) {
    per-disk locking is unneeded. */
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
+	disk_read_multiple (d, sec_no, 1, buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   DISK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
+	disk_write_multiple (d, sec_no, 1, buffer);
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFER, which must have room for CNT * DISK_SECTOR_SIZE bytes.
+   Each group of up to DISK_MULTIPLE_MAX sectors takes a single
+   command, rather than one per sector.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_read_multiple (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		void *buffer_) {
+	uint8_t *buffer = buffer_;
 	struct channel *c;
 
 	ASSERT (d != NULL);
 	ASSERT (buffer != NULL);
 
 	c = d->channel;
-	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-	sema_down (&c->completion_wait);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-	input_sector (c, buffer);
-	d->read_cnt++;
-	lock_release (&c->lock);
+	while (cnt > 0) {
+		size_t n = cnt < DISK_MULTIPLE_MAX ? cnt : DISK_MULTIPLE_MAX;
+		size_t i;
+
+		lock_acquire (&c->lock);
+		if (dma_usable (d, buffer, n) && dma_transfer (d, sec_no, n, buffer, false))
+			goto done;
+		select_sector (d, sec_no, n);
+		issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+		for (i = 0; i < n; i++) {
+			/* The disk interrupts once per sector it has ready. */
+			sema_down (&c->completion_wait);
+			if (!wait_while_busy (d))
+				PANIC ("%s: disk read failed, sector=%"PRDSNu,
+						d->name, sec_no + (disk_sector_t) i);
+			input_sector (c, buffer + i * DISK_SECTOR_SIZE);
+		}
+done:
+		d->read_cnt += n;
+		lock_release (&c->lock);
+
+		sec_no += n;
+		buffer += n * DISK_SECTOR_SIZE;
+		cnt -= n;
+	}
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   DISK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+   BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes.
+   Returns after the disk has acknowledged receiving the data.
+   Each group of up to DISK_MULTIPLE_MAX sectors takes a single
+   command, rather than one per sector.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 void
-disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
+disk_write_multiple (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		const void *buffer_) {
+	const uint8_t *buffer = buffer_;
 	struct channel *c;
 
 	ASSERT (d != NULL);
 	ASSERT (buffer != NULL);
 
 	c = d->channel;
-	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-	output_sector (c, buffer);
-	sema_down (&c->completion_wait);
-	d->write_cnt++;
-	lock_release (&c->lock);
+	while (cnt > 0) {
+		size_t n = cnt < DISK_MULTIPLE_MAX ? cnt : DISK_MULTIPLE_MAX;
+		size_t i;
+
+		lock_acquire (&c->lock);
+		if (dma_usable (d, buffer, n)
+				&& dma_transfer (d, sec_no, n, (void *) buffer, true))
+			goto done;
+		select_sector (d, sec_no, n);
+		issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+		for (i = 0; i < n; i++) {
+			/* The disk asks for each sector in turn, and interrupts
+			   once it has taken it. */
+			if (!wait_while_busy (d))
+				PANIC ("%s: disk write failed, sector=%"PRDSNu,
+						d->name, sec_no + (disk_sector_t) i);
+			output_sector (c, buffer + i * DISK_SECTOR_SIZE);
+			sema_down (&c->completion_wait);
+		}
+done:
+		d->write_cnt += n;
+		lock_release (&c->lock);
+
+		sec_no += n;
+		buffer += n * DISK_SECTOR_SIZE;
+		cnt -= n;
+	}
 }
-
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
@@ -364,6 +487,9 @@ identify_ata_device (struct disk *d) {
 	/* Calculate capacity. */
 	d->capacity = id[60] | ((uint32_t) id[61] << 16);
 
+	/* Word 49, bit 8 says whether DMA is supported. */
+	d->dma = (id[49] & 0x100) != 0;
+
 	/* Print identification message. */
 	printf ("%s: detected %'"PRDSNu" sector (", d->name, d->capacity);
 	if (d->capacity > 1024 / DISK_SECTOR_SIZE * 1024 * 1024)
@@ -402,17 +528,20 @@ print_ata_string (char *string, size_t size) {
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT to the disk's sector selection and
+   sector count registers.  (We use LBA mode.)  A CNT of
+   DISK_MULTIPLE_MAX is written as 0, which the disk takes to
+   mean 256. */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) {
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
 
-	ASSERT (sec_no < d->capacity);
-	ASSERT (sec_no < (1UL << 28));
+	ASSERT (cnt > 0 && cnt <= DISK_MULTIPLE_MAX);
+	ASSERT (sec_no < d->capacity && cnt <= d->capacity - sec_no);
+	ASSERT (sec_no + cnt <= (1UL << 28));
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	outb (reg_nsect (c), cnt % DISK_MULTIPLE_MAX);
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
@@ -446,6 +575,129 @@ output_sector (struct channel *c, const void *sector) {
 	outsw (reg_data (c), sector, DISK_SECTOR_SIZE / 2);
 }
 
+/* Bus-master DMA. */
+
+/* Returns the value of 32-bit register REG in the PCI
+   configuration space of function FUNC of device DEV on bus 0. */
+static uint32_t
+pci_read_config (int dev, int func, int reg) {
+	outl (PCI_CONFIG_ADDR, 0x80000000 | (dev << 11) | (func << 8) | reg);
+	return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to 32-bit register REG in the PCI configuration
+   space of function FUNC of device DEV on bus 0. */
+static void
+pci_write_config (int dev, int func, int reg, uint32_t value) {
+	outl (PCI_CONFIG_ADDR, 0x80000000 | (dev << 11) | (func << 8) | reg);
+	outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller capable of bus
+   mastering, turns bus mastering on, and returns the base of its
+   bus master ports.  The ports for the secondary channel follow
+   those of the primary at offset 8.  Returns 0 if there is no
+   such controller. */
+static uint16_t
+find_bus_master (void) {
+	int dev, func;
+
+	for (dev = 0; dev < 32; dev++)
+		for (func = 0; func < 8; func++) {
+			uint32_t class = pci_read_config (dev, func, 0x08);
+			uint32_t bar4;
+
+			if ((pci_read_config (dev, func, 0x00) & 0xffff) == 0xffff)
+				continue;
+
+			/* Mass storage (0x01), IDE (0x01), bus master capable
+			   (programming interface bit 7). */
+			if ((class >> 16) != 0x0101 || !(class & 0x8000))
+				continue;
+
+			/* BAR4 is the bus master I/O port range. */
+			bar4 = pci_read_config (dev, func, 0x20);
+			if (!(bar4 & 1) || (bar4 & 0xfffc) == 0)
+				continue;
+
+			/* Enable I/O space and bus mastering. */
+			pci_write_config (dev, func, 0x04,
+					pci_read_config (dev, func, 0x04) | 0x05);
+			printf ("disk: bus-master DMA at port %#x\n",
+					(unsigned) (bar4 & 0xfffc));
+			return bar4 & 0xfffc;
+		}
+
+	printf ("disk: no bus-master IDE controller, using PIO\n");
+	return 0;
+}
+
+/* Returns true if the transfer of CNT sectors between disk D and
+   BUFFER can use DMA.  The controller reaches physical memory
+   below 4 GB only, and BUFFER's physical address is known only
+   for kernel memory, all of which is mapped one to one. */
+static bool
+dma_usable (const struct disk *d, const void *buffer, size_t cnt) {
+	return (disk_dma && d->dma && d->channel->bm_base != 0
+			&& is_kernel_vaddr (buffer)
+			&& vtop (buffer) + cnt * DISK_SECTOR_SIZE <= (1ULL << 32));
+}
+
+/* Transfers CNT sectors starting at SEC_NO between disk D and
+   BUFFER by DMA, writing to the disk if WRITE is true and
+   reading otherwise.  The caller must hold D's channel lock.
+
+   Returns true if successful.  If the transfer fails, turns DMA
+   off for the channel and returns false, so that the caller can
+   fall back on PIO. */
+static bool
+dma_transfer (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		void *buffer, bool write) {
+	struct channel *c = d->channel;
+	uint64_t addr = vtop (buffer);
+	size_t left = cnt * DISK_SECTOR_SIZE;
+	size_t i;
+	uint8_t status;
+
+	ASSERT (lock_held_by_current_thread (&c->lock));
+
+	/* Describe BUFFER, split at 64 kB boundaries. */
+	for (i = 0; left > 0; i++) {
+		size_t size = 0x10000 - (addr & 0xffff);
+		if (size > left)
+			size = left;
+
+		ASSERT (i < PRD_CNT);
+		c->prdt[i].addr = addr;
+		c->prdt[i].size = size;     /* 64 kB truncates to 0, as wanted. */
+		c->prdt[i].flags = size == left ? PRD_EOT : 0;
+		addr += size;
+		left -= size;
+	}
+
+	/* Set up the controller, then the disk, then start. */
+	outl (reg_bm_prdt (c), vtop (c->prdt));
+	outb (reg_bm_command (c), write ? 0 : BM_CMD_READ);
+	outb (reg_bm_status (c), inb (reg_bm_status (c)) | BM_STA_ERR | BM_STA_INTR);
+	select_sector (d, sec_no, cnt);
+	issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+	outb (reg_bm_command (c), (write ? 0 : BM_CMD_READ) | BM_CMD_START);
+
+	/* The disk interrupts once, when it is done. */
+	sema_down (&c->completion_wait);
+	outb (reg_bm_command (c), 0);
+	status = inb (reg_bm_status (c));
+	outb (reg_bm_status (c), status | BM_STA_ERR | BM_STA_INTR);
+
+	if ((status & BM_STA_ERR) || (inb (reg_alt_status (c)) & STA_ERR)) {
+		printf ("%s: DMA %s failed, sector=%"PRDSNu", falling back to PIO\n",
+				d->name, write ? "write" : "read", sec_no);
+		c->bm_base = 0;
+		return false;
+	}
+	return true;
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
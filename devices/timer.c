@@ -1,13 +1,13 @@
 #include "devices/timer.h"
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stdio.h>
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
-#include "lib/kernel/list.h"
 
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -18,36 +18,83 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
+/* 8254 input frequency, and the counter value that divides it
+   down to TIMER_FREQ, rounded to nearest. */
+#define PIT_HZ 1193180
+#define PIT_COUNTS_PER_TICK ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Longest one-shot, in ticks, that fits the 16-bit counter. */
+#define PIT_MAX_ONESHOT_TICKS (0xffff / PIT_COUNTS_PER_TICK)
+
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* If false (default), the PIT interrupts every tick.
+   If true, the periodic tick is stopped while the CPU is idle and
+   the PIT is armed as a one-shot for the next sleeper's deadline.
+   Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* Tickless state.  ONESHOT_TICKS is the number of ticks the armed
+   one-shot covers, or 0 while the PIT runs periodically.
+   ONESHOT_COUNT is the value loaded into the counter, and
+   ONESHOT_PHASE the counts of the current tick that had already
+   elapsed when it was loaded. */
+static int64_t oneshot_ticks;
+static unsigned oneshot_count;
+static unsigned oneshot_phase;
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
 static intr_handler_func timer_interrupt;
+static void pit_set_periodic (void);
+static void timer_advance (int64_t cnt);
+static int64_t timer_next_deadline (void);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
-static bool cmp_wakeup_time(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED);
 
-static struct list sleep_list;
+/* Project 1 - alarm */
+/* Sleeping threads are kept in a hierarchical timing wheel.
+   Level 0 has one slot per tick for the next WHEEL_SIZE ticks,
+   and each higher level covers WHEEL_SIZE times the span of the
+   level below it.  A sleeper is filed in O(1) by the distance to
+   its wakeup tick; when the level 0 index wraps around, the next
+   slot of level 1 is redistributed ("cascaded") into level 0, and
+   so on up.  Deadlines beyond the last level wait on
+   sleep_overflow.  Both insert and expiry are O(1) amortized. */
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+
+static struct list sleep_wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static struct list sleep_overflow;
+
+/* Next tick whose level 0 slot has not been expired yet.
+   Always <= ticks + 1. */
+static int64_t wheel_tick;
+
+static void wheel_insert (struct thread *);
+static int wheel_cascade (int level);
+static bool wheel_expire (void);
 
 /* Sets up the 8254 Programmable Interval Timer (PIT) to
    interrupt PIT_FREQ times per second, and registers the
    corresponding interrupt. */
 void
 timer_init (void) {
-	/* 8254 input frequency divided by TIMER_FREQ, rounded to
-	   nearest. */
-	uint16_t count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
-
-	outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
-	outb (0x40, count & 0xff);
-	outb (0x40, count >> 8);
+	pit_set_periodic ();
 
 	intr_register_ext (0x20, timer_interrupt, "8254 Timer");
-	list_init(&sleep_list);
+
+	for (int level = 0; level < WHEEL_LEVELS; level++)
+		for (int slot = 0; slot < WHEEL_SIZE; slot++)
+			list_init (&sleep_wheel[level][slot]);
+	list_init (&sleep_overflow);
+	wheel_tick = ticks;
 }
 
 /* Calibrates loops_per_tick, used to implement brief delays. */
@@ -93,31 +140,30 @@ timer_elapsed (int64_t then) {
 }
 
 /* Suspends execution for approximately TICKS timer ticks. */
-
 void
 timer_sleep (int64_t ticks) {
-    int64_t start = timer_ticks();
-    int64_t wakeup = start + ticks;
-
-    ASSERT(intr_get_level() == INTR_ON);
-
-    enum intr_level old_level = intr_disable();
-
-    struct thread *cur = thread_current();
-    cur->wakeup_tick = wakeup;
-	
-    list_insert_ordered(&sleep_list, &cur->elem, cmp_wakeup_time, NULL);
-    thread_block();
-    intr_set_level (old_level);
+	timer_sleep_until (timer_ticks () + ticks);
 }
 
-/* Project 1 - alarm */
-bool
-cmp_wakeup_time(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED) {
-	struct thread *t_a = list_entry(a, struct thread, elem);
-	struct thread *t_b = list_entry(b, struct thread, elem);
+/* Suspends execution until the timer reaches tick ABS_TICK.
+   Returns immediately if ABS_TICK has already passed.  Periodic
+   tasks should advance an absolute deadline with this function
+   rather than call timer_sleep() with a relative delay, so that
+   their period does not drift by the time spent running. */
+void
+timer_sleep_until (int64_t abs_tick) {
+	struct thread *cur = thread_current ();
+	enum intr_level old_level;
+
+	ASSERT (intr_get_level () == INTR_ON);
 
-	return t_a->wakeup_tick < t_b->wakeup_tick;
+	old_level = intr_disable ();
+	if (abs_tick > ticks) {
+		cur->wakeup_tick = abs_tick;
+		wheel_insert (cur);
+		thread_block ();
+	}
+	intr_set_level (old_level);
 }
 
 /* Suspends execution for approximately MS milliseconds. */
@@ -144,22 +190,215 @@ timer_print_stats (void) {
 	printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
+/* Programs the PIT to interrupt TIMER_FREQ times per second. */
+static void
+pit_set_periodic (void) {
+	uint16_t count = PIT_COUNTS_PER_TICK;
+
+	outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
+	outb (0x40, count & 0xff);
+	outb (0x40, count >> 8);
+}
+
+/* Called by the idle thread, with interrupts off, just before it
+   halts.  In tickless mode, replaces the periodic tick by a
+   single interrupt at the earliest sleeper's deadline, or as far
+   ahead as the counter reaches. */
+void
+timer_idle_enter (void) {
+	int64_t delta;
+	uint16_t left;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (!timer_tickless || oneshot_ticks != 0)
+		return;
+
+	delta = timer_next_deadline () - ticks;
+	if (delta > PIT_MAX_ONESHOT_TICKS)
+		delta = PIT_MAX_ONESHOT_TICKS;
+	if (delta < 2)
+		return;
+
+	/* Latch the counter to find how far into the current tick we
+	   are, so that the one-shot lands on the tick boundary. */
+	outb (0x43, 0x00);    /* CW: counter 0, latch count. */
+	left = inb (0x40);
+	left |= inb (0x40) << 8;
+	if (left == 0 || left > PIT_COUNTS_PER_TICK)
+		return;
+
+	oneshot_ticks = delta;
+	oneshot_phase = PIT_COUNTS_PER_TICK - left;
+	oneshot_count = left + (delta - 1) * PIT_COUNTS_PER_TICK;
+	outb (0x43, 0x30);    /* CW: counter 0, LSB then MSB, mode 0, binary. */
+	outb (0x40, oneshot_count & 0xff);
+	outb (0x40, oneshot_count >> 8);
+}
+
+/* Called by the idle thread, with interrupts off, after it wakes
+   up.  If some other interrupt ended the halt before the one-shot
+   fired, credits the whole ticks that elapsed according to the
+   PIT counter and restores the periodic tick.  The fraction of a
+   tick in progress is dropped. */
+void
+timer_idle_exit (void) {
+	uint8_t status;
+	uint16_t left;
+	int64_t elapsed;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (oneshot_ticks == 0)
+		return;
+
+	outb (0x43, 0xc2);    /* Read-back: counter 0, status and count. */
+	status = inb (0x40);
+	left = inb (0x40);
+	left |= inb (0x40) << 8;
+
+	if (status & 0x80) {
+		/* OUT is high: the one-shot fired and its interrupt is
+		   pending.  That interrupt supplies the last tick. */
+		elapsed = oneshot_ticks - 1;
+	} else
+		elapsed = (oneshot_phase + oneshot_count - left) / PIT_COUNTS_PER_TICK;
+
+	oneshot_ticks = 0;
+	pit_set_periodic ();
+	timer_advance (elapsed);
+}
+
+/* Credits CNT ticks that passed without a timer interrupt, all of
+   them spent idle, and wakes any sleeper that became due. */
+static void
+timer_advance (int64_t cnt) {
+	ticks += cnt;
+	thread_account_idle (cnt);
+	while (wheel_tick <= ticks)
+		wheel_expire ();
+}
+
 /* Timer interrupt handler. */
 /* Project 1 - alarm */
 static void
 timer_interrupt (struct intr_frame *args UNUSED) {
-	ticks++;
-	enum intr_level old_level = intr_disable();
-
-	while(!list_empty(&sleep_list)){
-		struct thread *t = list_entry(list_front(&sleep_list), struct thread, elem);
-		if(t->wakeup_tick > ticks)
-			break;
-		list_pop_front(&sleep_list);
-		thread_unblock(t);
+	bool preempt = false;
+
+	if (oneshot_ticks != 0) {
+		/* The one-shot armed by timer_idle_enter() expired. */
+		int64_t elapsed = oneshot_ticks;
+
+		oneshot_ticks = 0;
+		pit_set_periodic ();
+		timer_advance (elapsed - 1);
 	}
-	intr_set_level(old_level);
+
+	ticks++;
+	while (wheel_tick <= ticks)
+		if (wheel_expire ())
+			preempt = true;
+
 	thread_tick ();
+	if (preempt)
+		intr_yield_on_return ();
+}
+
+/* Returns a tick at or before the earliest sleeper's wakeup
+   tick, or INT64_MAX if no thread is sleeping.  Level 0 slots are
+   exact; anything filed higher is reported as the next cascade
+   of level 1, which is early but safe. */
+static int64_t
+timer_next_deadline (void) {
+	int level, slot;
+
+	for (slot = 0; slot < WHEEL_SIZE; slot++)
+		if (!list_empty (&sleep_wheel[0][(wheel_tick + slot) & WHEEL_MASK]))
+			return wheel_tick + slot;
+
+	for (level = 1; level < WHEEL_LEVELS; level++)
+		for (slot = 0; slot < WHEEL_SIZE; slot++)
+			if (!list_empty (&sleep_wheel[level][slot]))
+				return ROUND_UP (wheel_tick, WHEEL_SIZE);
+	if (!list_empty (&sleep_overflow))
+		return ROUND_UP (wheel_tick, WHEEL_SIZE);
+	return INT64_MAX;
+}
+
+/* Files sleeping thread T in the wheel slot for T->wakeup_tick,
+   relative to wheel_tick.  Interrupts must be off. */
+static void
+wheel_insert (struct thread *t) {
+	int64_t delta = t->wakeup_tick - wheel_tick;
+	int64_t when = t->wakeup_tick;
+	int level;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	/* A deadline that has already passed is expired on the next
+	   slot to be processed. */
+	if (delta < 0) {
+		delta = 0;
+		when = wheel_tick;
+	}
+
+	for (level = 0; level < WHEEL_LEVELS; level++)
+		if (delta < (int64_t) 1 << (WHEEL_BITS * (level + 1))) {
+			int slot = (when >> (WHEEL_BITS * level)) & WHEEL_MASK;
+			list_push_back (&sleep_wheel[level][slot], &t->elem);
+			return;
+		}
+	list_push_back (&sleep_overflow, &t->elem);
+}
+
+/* Refiles every sleeper in the current slot of LEVEL into the
+   levels below it.  Returns the index of that slot, which is 0
+   exactly when the next level up is due to be cascaded too. */
+static int
+wheel_cascade (int level) {
+	int slot = (wheel_tick >> (WHEEL_BITS * level)) & WHEEL_MASK;
+	struct list *bucket = &sleep_wheel[level][slot];
+
+	while (!list_empty (bucket))
+		wheel_insert (list_entry (list_pop_front (bucket), struct thread, elem));
+	return slot;
+}
+
+/* Wakes every thread due at wheel_tick and advances wheel_tick.
+   Returns true if a woken thread outranks the running one. */
+static bool
+wheel_expire (void) {
+	int slot = wheel_tick & WHEEL_MASK;
+	struct list *bucket;
+	bool preempt = false;
+
+	if (slot == 0) {
+		int level;
+
+		for (level = 1; level < WHEEL_LEVELS; level++)
+			if (wheel_cascade (level) != 0)
+				break;
+		if (level == WHEEL_LEVELS) {
+			struct list overflow;
+
+			list_init (&overflow);
+			while (!list_empty (&sleep_overflow))
+				list_push_back (&overflow, list_pop_front (&sleep_overflow));
+			while (!list_empty (&overflow))
+				wheel_insert (list_entry (list_pop_front (&overflow),
+							struct thread, elem));
+		}
+	}
+
+	bucket = &sleep_wheel[0][slot];
+	while (!list_empty (bucket)) {
+		struct thread *t = list_entry (list_pop_front (bucket), struct thread, elem);
+		thread_unblock (t);
+		if (t->priority > thread_current ()->priority)
+			preempt = true;
+	}
+	wheel_tick++;
+	return preempt;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
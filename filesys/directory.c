@@ -1,10 +1,13 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir {
@@ -19,10 +22,112 @@ struct dir_entry {
 	bool in_use;                        /* In use or free? */
 };
 
+/* In-memory index of a directory's entries.
+
+   Finding a name by reading the directory's entries one by one
+   makes lookups, and the duplicate check in dir_add(), linear in
+   the size of the directory.  So the first lookup in a directory
+   reads all of its entries once into a hash table keyed on name,
+   which is then kept with the directory's inode for as long as
+   the inode is open, and kept up to date by dir_add() and
+   dir_remove().  The index also remembers the free slots, so
+   that dir_add() need not search for one.
+
+   If memory for the index cannot be had, lookups fall back to
+   reading the entries. */
+struct dir_index {
+	struct hash names;                  /* Index entries, by name. */
+	off_t *free_slots;                  /* Offsets of unused entries. */
+	size_t free_cnt;                    /* Number of FREE_SLOTS. */
+	size_t free_cap;                    /* Capacity of FREE_SLOTS. */
+	off_t end;                          /* Offset past the last entry. */
+};
+
+/* An in-use directory entry, in a dir_index. */
+struct index_entry {
+	struct hash_elem elem;              /* Element in names. */
+	off_t ofs;                          /* Offset of the entry. */
+	disk_sector_t inode_sector;         /* Sector number of header. */
+	char name[NAME_MAX + 1];            /* Null terminated file name. */
+};
+
+/* Name cache.
+
+   A directory's index lives only as long as its inode is open,
+   and most directories are opened just long enough to resolve a
+   single name.  The name cache instead keeps the results of
+   recent lookups across opens, keyed on the sector of the
+   directory looked in and the name looked for.  It also records
+   names that were not found, so that repeatedly probing for a
+   missing file costs no more than finding an existing one.
+
+   dir_add() and dir_remove() update the cache for the names they
+   change.  Entries for a directory's contents are dropped when a
+   directory is created in its sector, so that a sector reused by
+   a new directory cannot inherit its predecessor's names.  The
+   cache holds at most DENTRY_MAX entries and discards the least
+   recently used one to make room. */
+#define DENTRY_MAX 256
+
+/* INODE_SECTOR of a dentry for a name that does not exist. */
+#define DENTRY_NEGATIVE ((disk_sector_t) -1)
+
+/* A name cache entry. */
+struct dentry {
+	struct hash_elem elem;              /* Element in dentries. */
+	struct list_elem lru_elem;          /* Element in dentry_lru. */
+	disk_sector_t parent;               /* Sector of the directory. */
+	disk_sector_t inode_sector;         /* Sector, or DENTRY_NEGATIVE. */
+	char name[NAME_MAX + 1];            /* Null terminated file name. */
+};
+
+static struct hash dentries;            /* All dentries. */
+static struct list dentry_lru;          /* Most recently used first. */
+static struct lock dentry_lock;         /* Protects the above. */
+static struct kmem_cache *dentry_cache;
+
+/* Cache of open directories. */
+static struct kmem_cache *dir_cache;
+
+/* Serializes lookups and changes in directories, and with them
+ * each directory's index.  Also held while the inode named by an
+ * entry is opened, so that the entry cannot be removed and its
+ * sector freed and reused before the open takes a reference. */
+static struct lock dir_lock;
+
+static struct dir_index *get_index (const struct dir *);
+static struct index_entry *index_find (struct dir_index *, const char *name);
+static bool index_add (struct dir_index *, const char *name,
+		disk_sector_t, off_t ofs);
+static bool push_free_slot (struct dir_index *, off_t ofs);
+static hash_hash_func index_hash;
+static hash_less_func index_less;
+static bool dentry_lookup (disk_sector_t parent, const char *name,
+		disk_sector_t *sectorp);
+static void dentry_insert (disk_sector_t parent, const char *name,
+		disk_sector_t inode_sector);
+static void dentry_purge (disk_sector_t parent);
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+
+/* Initializes the directory module. */
+void
+dir_init (void) {
+	dir_cache = kmem_cache_create ("dir", sizeof (struct dir), 0, NULL);
+	dentry_cache = kmem_cache_create ("dentry", sizeof (struct dentry), 0,
+			NULL);
+	if (!hash_init (&dentries, dentry_hash, dentry_less, NULL))
+		PANIC ("out of memory creating name cache");
+	list_init (&dentry_lru);
+	lock_init (&dentry_lock);
+	lock_init (&dir_lock);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
  * given SECTOR.  Returns true if successful, false on failure. */
 bool
 dir_create (disk_sector_t sector, size_t entry_cnt) {
+	dentry_purge (sector);
 	return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
 }
 
@@ -30,14 +135,14 @@ dir_create (disk_sector_t sector, size_t entry_cnt) {
  * it takes ownership.  Returns a null pointer on failure. */
 struct dir *
 dir_open (struct inode *inode) {
-	struct dir *dir = calloc (1, sizeof *dir);
+	struct dir *dir = kmem_cache_zalloc (dir_cache);
 	if (inode != NULL && dir != NULL) {
 		dir->inode = inode;
 		dir->pos = 0;
 		return dir;
 	} else {
 		inode_close (inode);
-		free (dir);
+		kmem_cache_free (dir_cache, dir);
 		return NULL;
 	}
 }
@@ -61,7 +166,7 @@ void
 dir_close (struct dir *dir) {
 	if (dir != NULL) {
 		inode_close (dir->inode);
-		free (dir);
+		kmem_cache_free (dir_cache, dir);
 	}
 }
 
@@ -79,12 +184,29 @@ dir_get_inode (struct dir *dir) {
 static bool
 lookup (const struct dir *dir, const char *name,
 		struct dir_entry *ep, off_t *ofsp) {
+	struct dir_index *index;
 	struct dir_entry e;
 	size_t ofs;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	index = get_index (dir);
+	if (index != NULL) {
+		struct index_entry *ie = index_find (index, name);
+		if (ie == NULL)
+			return false;
+		if (ep != NULL) {
+			memset (ep, 0, sizeof *ep);
+			ep->inode_sector = ie->inode_sector;
+			strlcpy (ep->name, ie->name, sizeof ep->name);
+			ep->in_use = true;
+		}
+		if (ofsp != NULL)
+			*ofsp = ie->ofs;
+		return true;
+	}
+
 	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 			ofs += sizeof e)
 		if (e.in_use && !strcmp (name, e.name)) {
@@ -104,15 +226,25 @@ lookup (const struct dir *dir, const char *name,
 bool
 dir_lookup (const struct dir *dir, const char *name,
 		struct inode **inode) {
+	disk_sector_t parent, sector;
 	struct dir_entry e;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	if (lookup (dir, name, &e, NULL))
-		*inode = inode_open (e.inode_sector);
-	else
-		*inode = NULL;
+	*inode = NULL;
+	if (strlen (name) > NAME_MAX)
+		return false;
+
+	parent = inode_get_inumber (dir->inode);
+	lock_acquire (&dir_lock);
+	if (!dentry_lookup (parent, name, &sector)) {
+		sector = lookup (dir, name, &e, NULL) ? e.inode_sector : DENTRY_NEGATIVE;
+		dentry_insert (parent, name, sector);
+	}
+	if (sector != DENTRY_NEGATIVE)
+		*inode = inode_open (sector);
+	lock_release (&dir_lock);
 
 	return *inode != NULL;
 }
@@ -125,6 +257,7 @@ dir_lookup (const struct dir *dir, const char *name,
  * error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
+	struct dir_index *index;
 	struct dir_entry e;
 	off_t ofs;
 	bool success = false;
@@ -137,6 +270,7 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 		return false;
 
 	/* Check that NAME is not in use. */
+	lock_acquire (&dir_lock);
 	if (lookup (dir, name, NULL, NULL))
 		goto done;
 
@@ -147,10 +281,18 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	 * inode_read_at() will only return a short read at end of file.
 	 * Otherwise, we'd need to verify that we didn't get a short
 	 * read due to something intermittent such as low memory. */
-	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-			ofs += sizeof e)
-		if (!e.in_use)
-			break;
+	index = get_index (dir);
+	if (index != NULL) {
+		ofs = index->free_cnt > 0
+			? index->free_slots[index->free_cnt - 1] : index->end;
+		if (!index_add (index, name, inode_sector, ofs))
+			goto done;
+		memset (&e, 0, sizeof e);
+	} else
+		for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+				ofs += sizeof e)
+			if (!e.in_use)
+				break;
 
 	/* Write slot. */
 	e.in_use = true;
@@ -158,7 +300,22 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	e.inode_sector = inode_sector;
 	success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
+	/* Bring the index in line with the outcome. */
+	if (index != NULL) {
+		if (!success) {
+			struct index_entry *ie = index_find (index, name);
+			hash_delete (&index->names, &ie->elem);
+			free (ie);
+		} else if (ofs == index->end)
+			index->end += sizeof e;
+		else
+			index->free_cnt--;
+	}
+	if (success)
+		dentry_insert (inode_get_inumber (dir->inode), name, inode_sector);
+
 done:
+	lock_release (&dir_lock);
 	return success;
 }
 
@@ -167,6 +324,7 @@ done:
  * which occurs only if there is no file with the given NAME. */
 bool
 dir_remove (struct dir *dir, const char *name) {
+	struct dir_index *index;
 	struct dir_entry e;
 	struct inode *inode = NULL;
 	bool success = false;
@@ -176,6 +334,7 @@ dir_remove (struct dir *dir, const char *name) {
 	ASSERT (name != NULL);
 
 	/* Find directory entry. */
+	lock_acquire (&dir_lock);
 	if (!lookup (dir, name, &e, &ofs))
 		goto done;
 
@@ -189,11 +348,29 @@ dir_remove (struct dir *dir, const char *name) {
 	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
 		goto done;
 
-	/* Remove inode. */
-	inode_remove (inode);
+	/* Drop it from the index.  If its slot cannot be remembered as
+	 * free, the index cannot be trusted to find free slots, so it
+	 * is thrown away to be rebuilt. */
+	index = get_index (dir);
+	if (index != NULL) {
+		struct index_entry *ie = index_find (index, name);
+		hash_delete (&index->names, &ie->elem);
+		free (ie);
+		if (!push_free_slot (index, ofs)) {
+			dir_index_destroy (index);
+			inode_set_dir_index (dir->inode, NULL);
+		}
+	}
+
+	dentry_insert (inode_get_inumber (dir->inode), name, DENTRY_NEGATIVE);
 	success = true;
 
 done:
+	lock_release (&dir_lock);
+
+	/* Remove inode. */
+	if (success)
+		inode_remove (inode);
 	inode_close (inode);
 	return success;
 }
@@ -214,3 +391,213 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
 	}
 	return false;
 }
+
+/* Returns DIR's index, building it if this is the first lookup
+ * since DIR's inode was opened.  Returns a null pointer if memory
+ * allocation fails. */
+static struct dir_index *
+get_index (const struct dir *dir) {
+	struct dir_index *index = inode_get_dir_index (dir->inode);
+	struct dir_entry e;
+	off_t ofs;
+
+	if (index != NULL)
+		return index;
+
+	index = malloc (sizeof *index);
+	if (index == NULL)
+		return NULL;
+	if (!hash_init (&index->names, index_hash, index_less, NULL)) {
+		free (index);
+		return NULL;
+	}
+	index->free_slots = NULL;
+	index->free_cnt = index->free_cap = 0;
+
+	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+			ofs += sizeof e)
+		if (e.in_use ? !index_add (index, e.name, e.inode_sector, ofs)
+				: !push_free_slot (index, ofs)) {
+			dir_index_destroy (index);
+			return NULL;
+		}
+	index->end = ofs;
+
+	inode_set_dir_index (dir->inode, index);
+	return index;
+}
+
+/* Returns the entry for NAME in INDEX, or a null pointer if there
+ * is none. */
+static struct index_entry *
+index_find (struct dir_index *index, const char *name) {
+	struct index_entry key;
+	struct hash_elem *e;
+
+	if (strlen (name) > NAME_MAX)
+		return NULL;
+	strlcpy (key.name, name, sizeof key.name);
+	e = hash_find (&index->names, &key.elem);
+	return e != NULL ? hash_entry (e, struct index_entry, elem) : NULL;
+}
+
+/* Adds an entry for NAME, at OFS and referring to INODE_SECTOR,
+ * to INDEX.  Returns false if memory allocation fails. */
+static bool
+index_add (struct dir_index *index, const char *name,
+		disk_sector_t inode_sector, off_t ofs) {
+	struct index_entry *ie = malloc (sizeof *ie);
+	if (ie == NULL)
+		return false;
+	ie->ofs = ofs;
+	ie->inode_sector = inode_sector;
+	strlcpy (ie->name, name, sizeof ie->name);
+	hash_insert (&index->names, &ie->elem);
+	return true;
+}
+
+/* Remembers that the entry at OFS in INDEX's directory is free.
+ * Returns false if memory allocation fails. */
+static bool
+push_free_slot (struct dir_index *index, off_t ofs) {
+	if (index->free_cnt == index->free_cap) {
+		size_t cap = index->free_cap != 0 ? index->free_cap * 2 : 8;
+		off_t *slots = realloc (index->free_slots, cap * sizeof *slots);
+		if (slots == NULL)
+			return false;
+		index->free_slots = slots;
+		index->free_cap = cap;
+	}
+	index->free_slots[index->free_cnt++] = ofs;
+	return true;
+}
+
+/* Frees an index entry. */
+static void
+free_index_entry (struct hash_elem *e, void *aux UNUSED) {
+	free (hash_entry (e, struct index_entry, elem));
+}
+
+/* Frees INDEX, which may be null.  Called when the inode it
+ * belongs to is freed. */
+void
+dir_index_destroy (struct dir_index *index) {
+	if (index != NULL) {
+		hash_destroy (&index->names, free_index_entry);
+		free (index->free_slots);
+		free (index);
+	}
+}
+
+/* Hashes an index entry by name. */
+static uint64_t
+index_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_string (hash_entry (e, struct index_entry, elem)->name);
+}
+
+/* Orders index entries by name. */
+static bool
+index_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return strcmp (hash_entry (a, struct index_entry, elem)->name,
+			hash_entry (b, struct index_entry, elem)->name) < 0;
+}
+
+/* Looks up NAME in directory PARENT in the name cache.  If it is
+ * there, sets *SECTORP to the sector of its inode, or to
+ * DENTRY_NEGATIVE if the name is known not to exist, and returns
+ * true.  Otherwise returns false. */
+static bool
+dentry_lookup (disk_sector_t parent, const char *name,
+		disk_sector_t *sectorp) {
+	struct dentry key;
+	struct hash_elem *e;
+
+	key.parent = parent;
+	strlcpy (key.name, name, sizeof key.name);
+
+	lock_acquire (&dentry_lock);
+	e = hash_find (&dentries, &key.elem);
+	if (e != NULL) {
+		struct dentry *d = hash_entry (e, struct dentry, elem);
+		list_remove (&d->lru_elem);
+		list_push_front (&dentry_lru, &d->lru_elem);
+		*sectorp = d->inode_sector;
+	}
+	lock_release (&dentry_lock);
+	return e != NULL;
+}
+
+/* Records in the name cache that NAME in directory PARENT refers
+ * to INODE_SECTOR, or does not exist if INODE_SECTOR is
+ * DENTRY_NEGATIVE.  If memory is short, just forgets NAME. */
+static void
+dentry_insert (disk_sector_t parent, const char *name,
+		disk_sector_t inode_sector) {
+	struct dentry key;
+	struct dentry *d;
+	struct hash_elem *e;
+
+	key.parent = parent;
+	strlcpy (key.name, name, sizeof key.name);
+
+	lock_acquire (&dentry_lock);
+	e = hash_find (&dentries, &key.elem);
+	if (e != NULL) {
+		d = hash_entry (e, struct dentry, elem);
+		list_remove (&d->lru_elem);
+	} else if (hash_size (&dentries) >= DENTRY_MAX) {
+		/* Reuse the least recently used entry. */
+		d = list_entry (list_pop_back (&dentry_lru), struct dentry, lru_elem);
+		hash_delete (&dentries, &d->elem);
+	} else
+		d = kmem_cache_alloc (dentry_cache);
+
+	if (d != NULL) {
+		if (e == NULL) {
+			d->parent = parent;
+			strlcpy (d->name, name, sizeof d->name);
+			hash_insert (&dentries, &d->elem);
+		}
+		d->inode_sector = inode_sector;
+		list_push_front (&dentry_lru, &d->lru_elem);
+	}
+	lock_release (&dentry_lock);
+}
+
+/* Drops every name cache entry for a name in directory PARENT. */
+static void
+dentry_purge (disk_sector_t parent) {
+	struct list_elem *e;
+
+	lock_acquire (&dentry_lock);
+	for (e = list_begin (&dentry_lru); e != list_end (&dentry_lru);) {
+		struct dentry *d = list_entry (e, struct dentry, lru_elem);
+		e = list_next (e);
+		if (d->parent == parent) {
+			list_remove (&d->lru_elem);
+			hash_delete (&dentries, &d->elem);
+			kmem_cache_free (dentry_cache, d);
+		}
+	}
+	lock_release (&dentry_lock);
+}
+
+/* Hashes a dentry by directory and name. */
+static uint64_t
+dentry_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct dentry *d = hash_entry (e, struct dentry, elem);
+	return hash_string (d->name) ^ hash_int (d->parent);
+}
+
+/* Orders dentries by directory, then by name. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct dentry *a = hash_entry (a_, struct dentry, elem);
+	const struct dentry *b = hash_entry (b_, struct dentry, elem);
+
+	if (a->parent != b->parent)
+		return a->parent < b->parent;
+	return strcmp (a->name, b->name) < 0;
+}
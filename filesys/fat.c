@@ -1,6 +1,7 @@
 #include "filesys/fat.h"
 #include "devices/disk.h"
 #include "filesys/filesys.h"
+#include "filesys/page_cache.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
 #include <stdio.h>
@@ -38,12 +39,7 @@ fat_init (void) {
 		PANIC ("FAT init failed");
 
 	// Read boot sector from the disk
-	unsigned int *bounce = malloc (DISK_SECTOR_SIZE);
-	if (bounce == NULL)
-		PANIC ("FAT init failed");
-	disk_read (filesys_disk, FAT_BOOT_SECTOR, bounce);
-	memcpy (&fat_fs->bs, bounce, sizeof (fat_fs->bs));
-	free (bounce);
+	pagecache_read (FAT_BOOT_SECTOR, &fat_fs->bs, 0, sizeof (fat_fs->bs));
 
 	// Extract FAT info
 	if (fat_fs->bs.magic != FAT_MAGIC)
@@ -57,59 +53,37 @@ fat_open (void) {
 	if (fat_fs->fat == NULL)
 		PANIC ("FAT load failed");
 
-	// Load FAT directly from the disk
+	// Load FAT from the disk, whole sectors in as few commands as
+	// possible, then the partial last sector
 	uint8_t *buffer = (uint8_t *) fat_fs->fat;
-	off_t bytes_read = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
 	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_read;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i,
-			           buffer + bytes_read);
-			bytes_read += DISK_SECTOR_SIZE;
-		} else {
-			uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT load failed");
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			memcpy (buffer + bytes_read, bounce, bytes_left);
-			bytes_read += bytes_left;
-			free (bounce);
-		}
-	}
+	const size_t whole = fat_size_in_bytes / DISK_SECTOR_SIZE;
+	const off_t tail = fat_size_in_bytes % DISK_SECTOR_SIZE;
+	pagecache_read_multiple (fat_fs->bs.fat_start, whole, buffer);
+	if (tail > 0)
+		pagecache_read (fat_fs->bs.fat_start + whole,
+		                buffer + whole * DISK_SECTOR_SIZE, 0, tail);
 }
 
 void
 fat_close (void) {
 	// Write FAT boot sector
-	uint8_t *bounce = calloc (1, DISK_SECTOR_SIZE);
-	if (bounce == NULL)
-		PANIC ("FAT close failed");
-	memcpy (bounce, &fat_fs->bs, sizeof (fat_fs->bs));
-	disk_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
-	free (bounce);
-
-	// Write FAT directly to the disk
+	pagecache_write (FAT_BOOT_SECTOR, &fat_fs->bs, 0, sizeof (fat_fs->bs));
+
+	// Write FAT to the disk
 	uint8_t *buffer = (uint8_t *) fat_fs->fat;
 	off_t bytes_wrote = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
+	off_t bytes_left;
 	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
 	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
 		bytes_left = fat_size_in_bytes - bytes_wrote;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i,
-			            buffer + bytes_wrote);
-			bytes_wrote += DISK_SECTOR_SIZE;
-		} else {
-			bounce = calloc (1, DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT close failed");
-			memcpy (bounce, buffer + bytes_wrote, bytes_left);
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			bytes_wrote += bytes_left;
-			free (bounce);
-		}
+		if (bytes_left <= 0)
+			break;
+		if (bytes_left > DISK_SECTOR_SIZE)
+			bytes_left = DISK_SECTOR_SIZE;
+		pagecache_write (fat_fs->bs.fat_start + i, buffer + bytes_wrote,
+		                 0, bytes_left);
+		bytes_wrote += bytes_left;
 	}
 }
 
@@ -128,11 +102,9 @@ fat_create (void) {
 	fat_put (ROOT_DIR_CLUSTER, EOChain);
 
 	// Fill up ROOT_DIR_CLUSTER region with 0
-	uint8_t *buf = calloc (1, DISK_SECTOR_SIZE);
-	if (buf == NULL)
-		PANIC ("FAT create failed due to OOM");
-	disk_write (filesys_disk, cluster_to_sector (ROOT_DIR_CLUSTER), buf);
-	free (buf);
+	static uint8_t zeros[DISK_SECTOR_SIZE];
+	pagecache_write (cluster_to_sector (ROOT_DIR_CLUSTER), zeros,
+	                 0, DISK_SECTOR_SIZE);
 }
 
 void
@@ -152,7 +124,11 @@ fat_boot_create (void) {
 
 void
 fat_fs_init (void) {
-	/* TODO: Your code goes here. */
+	fat_fs->data_start = fat_fs->bs.fat_start + fat_fs->bs.fat_sectors;
+	fat_fs->fat_length = (fat_fs->bs.total_sectors - fat_fs->data_start)
+	                     / SECTORS_PER_CLUSTER + 1;
+	fat_fs->last_clst = ROOT_DIR_CLUSTER;
+	lock_init (&fat_fs->write_lock);
 }
 
 /*----------------------------------------------------------------------------*/
@@ -177,17 +153,20 @@ fat_remove_chain (cluster_t clst, cluster_t pclst) {
 /* Update a value in the FAT table. */
 void
 fat_put (cluster_t clst, cluster_t val) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	fat_fs->fat[clst] = val;
 }
 
 /* Fetch a value in the FAT table. */
 cluster_t
 fat_get (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	return fat_fs->fat[clst];
 }
 
 /* Covert a cluster # to a sector number. */
 disk_sector_t
 cluster_to_sector (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	return fat_fs->data_start + (clst - 1) * SECTORS_PER_CLUSTER;
 }
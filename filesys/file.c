@@ -1,29 +1,52 @@
 #include "filesys/file.h"
 #include <debug.h>
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
+
+/* Read-ahead window, in sectors, when a sequential stream is
+ * first detected, and the largest it grows to. */
+#define RA_MIN_WINDOW 4
+#define RA_MAX_WINDOW 16
 
 /* An open file. */
 struct file {
 	struct inode *inode;        /* File's inode. */
 	off_t pos;                  /* Current position. */
 	bool deny_write;            /* Has file_deny_write() been called? */
+
+	/* Read-ahead state. */
+	off_t ra_next;              /* Offset a sequential read starts at. */
+	off_t ra_end;               /* End of the data already requested. */
+	int ra_window;              /* Sectors to keep requested, 0 if random. */
 };
 
+static void readahead (struct file *, off_t ofs, off_t bytes_read);
+
+/* Cache of open files. */
+static struct kmem_cache *file_cache;
+
+/* Initializes the file module. */
+void
+file_init (void) {
+	file_cache = kmem_cache_create ("file", sizeof (struct file), 0, NULL);
+}
+
 /* Opens a file for the given INODE, of which it takes ownership,
  * and returns the new file.  Returns a null pointer if an
  * allocation fails or if INODE is null. */
 struct file *
 file_open (struct inode *inode) {
-	struct file *file = calloc (1, sizeof *file);
+	struct file *file = kmem_cache_zalloc (file_cache);
 	if (inode != NULL && file != NULL) {
 		file->inode = inode;
 		file->pos = 0;
 		file->deny_write = false;
+		file->ra_next = file->ra_end = 0;
+		file->ra_window = 0;
 		return file;
 	} else {
 		inode_close (inode);
-		free (file);
+		kmem_cache_free (file_cache, file);
 		return NULL;
 	}
 }
@@ -54,7 +77,7 @@ file_close (struct file *file) {
 	if (file != NULL) {
 		file_allow_write (file);
 		inode_close (file->inode);
-		free (file);
+		kmem_cache_free (file_cache, file);
 	}
 }
 
@@ -72,6 +95,7 @@ file_get_inode (struct file *file) {
 off_t
 file_read (struct file *file, void *buffer, off_t size) {
 	off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+	readahead (file, file->pos, bytes_read);
 	file->pos += bytes_read;
 	return bytes_read;
 }
@@ -83,7 +107,43 @@ file_read (struct file *file, void *buffer, off_t size) {
  * The file's current position is unaffected. */
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) {
-	return inode_read_at (file->inode, buffer, size, file_ofs);
+	off_t bytes_read = inode_read_at (file->inode, buffer, size, file_ofs);
+	readahead (file, file_ofs, bytes_read);
+	return bytes_read;
+}
+
+/* Notes that BYTES_READ bytes were just read from FILE starting
+ * at OFS.  A read that picks up where the previous one left off
+ * is taken as part of a sequential stream, and the data just
+ * past it is requested ahead of time.  The amount requested
+ * doubles with each further sequential read, up to
+ * RA_MAX_WINDOW sectors, and any other read turns read-ahead off
+ * until the next sequential one. */
+static void
+readahead (struct file *file, off_t ofs, off_t bytes_read) {
+	off_t start, end;
+
+	if (bytes_read == 0)
+		return;
+	if (ofs != file->ra_next) {
+		file->ra_next = ofs + bytes_read;
+		file->ra_end = 0;
+		file->ra_window = 0;
+		return;
+	}
+
+	file->ra_next = ofs + bytes_read;
+	if (file->ra_window == 0)
+		file->ra_window = RA_MIN_WINDOW;
+	else if (file->ra_window < RA_MAX_WINDOW)
+		file->ra_window *= 2;
+
+	start = file->ra_end > file->ra_next ? file->ra_end : file->ra_next;
+	end = file->ra_next + file->ra_window * DISK_SECTOR_SIZE;
+	if (end > start) {
+		inode_readahead (file->inode, start, end - start);
+		file->ra_end = end;
+	}
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
@@ -6,6 +6,7 @@
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/page_cache.h"
 #include "devices/disk.h"
 
 /* The disk that contains the file system. */
@@ -21,7 +22,10 @@ filesys_init (bool format) {
 	if (filesys_disk == NULL)
 		PANIC ("hd0:1 (hdb) not present, file system initialization failed");
 
+	pagecache_init ();
 	inode_init ();
+	file_init ();
+	dir_init ();
 
 #ifdef EFILESYS
 	fat_init ();
@@ -51,6 +55,7 @@ filesys_done (void) {
 #else
 	free_map_close ();
 #endif
+	pagecache_flush ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -4,9 +4,11 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+static struct lock free_map_lock;    /* Protects the free map. */
 
 /* Initializes the free map. */
 void
@@ -16,6 +18,7 @@ free_map_init (void) {
 		PANIC ("bitmap creation failed--disk is too large");
 	bitmap_mark (free_map, FREE_MAP_SECTOR);
 	bitmap_mark (free_map, ROOT_DIR_SECTOR);
+	lock_init (&free_map_lock);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -24,13 +27,28 @@ free_map_init (void) {
  * available. */
 bool
 free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
-	disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+	return free_map_allocate_near (0, cnt, sectorp);
+}
+
+/* Like free_map_allocate(), but prefers the first run of CNT free
+ * sectors at or after HINT, falling back to the first anywhere. */
+bool
+free_map_allocate_near (disk_sector_t hint, size_t cnt,
+		disk_sector_t *sectorp) {
+	size_t sector = BITMAP_ERROR;
+
+	lock_acquire (&free_map_lock);
+	if (hint < bitmap_size (free_map))
+		sector = bitmap_scan_and_flip (free_map, hint, cnt, false);
+	if (sector == BITMAP_ERROR && hint > 0)
+		sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
 	if (sector != BITMAP_ERROR
 			&& free_map_file != NULL
-			&& !bitmap_write (free_map, free_map_file)) {
+			&& !bitmap_write_range (free_map, free_map_file, sector, cnt)) {
 		bitmap_set_multiple (free_map, sector, cnt, false);
 		sector = BITMAP_ERROR;
 	}
+	lock_release (&free_map_lock);
 	if (sector != BITMAP_ERROR)
 		*sectorp = sector;
 	return sector != BITMAP_ERROR;
@@ -39,9 +57,12 @@ free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (disk_sector_t sector, size_t cnt) {
+	lock_acquire (&free_map_lock);
 	ASSERT (bitmap_all (free_map, sector, cnt));
 	bitmap_set_multiple (free_map, sector, cnt, false);
-	bitmap_write (free_map, free_map_file);
+	if (free_map_file != NULL)
+		bitmap_write_range (free_map, free_map_file, sector, cnt);
+	lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
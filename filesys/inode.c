@@ -1,22 +1,49 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/directory.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/page_cache.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* A run of contiguous data sectors. */
+struct extent {
+	uint32_t ofs;                       /* Index of first sector in file. */
+	disk_sector_t start;                /* First disk sector. */
+	uint32_t cnt;                       /* Number of sectors. */
+};
+
+/* Number of extents kept in the inode itself, and in each extent
+ * block after that. */
+#define INODE_EXTENTS 41
+#define BLOCK_EXTENTS 42
+
 /* On-disk inode.
  * Must be exactly DISK_SECTOR_SIZE bytes long. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
-	uint32_t unused[125];               /* Not used. */
+	uint32_t extent_cnt;                /* Number of extents in all. */
+	disk_sector_t blocks;               /* First extent block, or 0. */
+	struct extent extents[INODE_EXTENTS]; /* First extents. */
+	uint32_t unused[1];                 /* Not used. */
+};
+
+/* Extent block, holding the extents that do not fit in the inode.
+ * Extent blocks form a chain starting at the inode.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct extent_block {
+	disk_sector_t next;                 /* Next extent block, or 0. */
+	uint32_t unused;                    /* Not used. */
+	struct extent extents[BLOCK_EXTENTS]; /* Extents. */
 };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -28,35 +55,121 @@ bytes_to_sectors (off_t size) {
 
 /* In-memory inode. */
 struct inode {
-	struct list_elem elem;              /* Element in inode list. */
+	struct hash_elem elem;              /* Element in open_inodes. */
 	disk_sector_t sector;               /* Sector number of disk location. */
 	int open_cnt;                       /* Number of openers. */
+	bool loading;                       /* Being read in by inode_open()? */
+	bool failed;                        /* Could not be read in? */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
 	struct inode_disk data;             /* Inode content. */
+	struct extent *extents;             /* All DATA.extent_cnt extents. */
+	size_t extent_cap;                  /* Capacity of EXTENTS. */
+	disk_sector_t *blocks;              /* Sectors of extent blocks. */
+	size_t block_cnt;                   /* Number of extent blocks. */
+	struct dir_index *dir_index;        /* Directory index, or null. */
+
+	/* Readers of the file's data and layout hold RW for reading.
+	 * Anything that changes the layout, such as a write that
+	 * extends the file, holds it for writing, so that independent
+	 * files, and reads of one file, proceed concurrently. */
+	struct rwlock rw;
 };
 
+static bool load_extents (struct inode *);
+static bool grow (struct inode *, off_t length);
+static bool add_extent (struct inode *, disk_sector_t start, size_t cnt);
+static bool write_extents (struct inode *, size_t first);
+static void release_data (struct inode *);
+
+/* Returns the number of data sectors allocated to INODE. */
+static size_t
+allocated_sectors (const struct inode *inode) {
+	const struct extent *last;
+
+	if (inode->data.extent_cnt == 0)
+		return 0;
+	last = &inode->extents[inode->data.extent_cnt - 1];
+	return last->ofs + last->cnt;
+}
+
+/* Returns the extent of INODE that holds its IDX'th sector, found
+ * by binary search.  INODE must have such a sector. */
+static const struct extent *
+find_extent (const struct inode *inode, size_t idx) {
+	size_t lo, hi;
+
+	/* Find the last extent that starts at or before IDX. */
+	lo = 0;
+	hi = inode->data.extent_cnt;
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (inode->extents[mid].ofs <= idx)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	ASSERT (idx - inode->extents[lo].ofs < inode->extents[lo].cnt);
+	return &inode->extents[lo];
+}
+
 /* Returns the disk sector that contains byte offset POS within
  * INODE.
  * Returns -1 if INODE does not contain data for a byte at offset
  * POS. */
 static disk_sector_t
 byte_to_sector (const struct inode *inode, off_t pos) {
+	const struct extent *e;
+	size_t idx;
+
 	ASSERT (inode != NULL);
-	if (pos < inode->data.length)
-		return inode->data.start + pos / DISK_SECTOR_SIZE;
-	else
+	if (pos >= inode->data.length)
 		return -1;
+
+	idx = pos / DISK_SECTOR_SIZE;
+	e = find_extent (inode, idx);
+	return e->start + (idx - e->ofs);
 }
 
-/* List of open inodes, so that opening a single inode twice
- * returns the same `struct inode'. */
-static struct list open_inodes;
+/* Returns how many sectors, up to MAX, follow on disk one after
+ * another starting with the one that holds byte offset POS
+ * within INODE. */
+static size_t
+sectors_in_run (const struct inode *inode, off_t pos, size_t max) {
+	size_t idx = pos / DISK_SECTOR_SIZE;
+	const struct extent *e = find_extent (inode, idx);
+	size_t left = e->cnt - (idx - e->ofs);
+
+	return left < max ? left : max;
+}
+
+/* Open inodes, by sector, so that opening a single inode twice
+ * returns the same `struct inode'.
+ *
+ * OPEN_INODES_LOCK protects the table and every open inode's
+ * OPEN_CNT, LOADING, and FAILED members.  It is never held across
+ * disk I/O: an inode being read in is put in the table with
+ * LOADING set, and anyone else opening it waits on
+ * INODE_LOADED. */
+static struct hash open_inodes;
+static struct lock open_inodes_lock;
+static struct condition inode_loaded;
+
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
+static void free_inode (struct inode *);
+
+/* Cache of in-memory inodes. */
+static struct kmem_cache *inode_cache;
 
 /* Initializes the inode module. */
 void
 inode_init (void) {
-	list_init (&open_inodes);
+	if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+		PANIC ("out of memory creating open inode table");
+	lock_init (&open_inodes_lock);
+	cond_init (&inode_loaded);
+	inode_cache = kmem_cache_create ("inode", sizeof (struct inode), 0, NULL);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -77,21 +190,22 @@ inode_create (disk_sector_t sector, off_t length) {
 
 	disk_inode = calloc (1, sizeof *disk_inode);
 	if (disk_inode != NULL) {
-		size_t sectors = bytes_to_sectors (length);
-		disk_inode->length = length;
+		struct inode *inode;
+
+		/* Write out an empty inode, then grow it to LENGTH. */
 		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			disk_write (filesys_disk, sector, disk_inode);
-			if (sectors > 0) {
-				static char zeros[DISK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++) 
-					disk_write (filesys_disk, disk_inode->start + i, zeros); 
-			}
-			success = true; 
-		} 
+		pagecache_write (sector, disk_inode, 0, DISK_SECTOR_SIZE);
 		free (disk_inode);
+
+		inode = inode_open (sector);
+		if (inode != NULL) {
+			rwlock_acquire_write (&inode->rw);
+			success = grow (inode, length);
+			if (!success)
+				release_data (inode);
+			rwlock_release_write (&inode->rw);
+			inode_close (inode);
+		}
 	}
 	return success;
 }
@@ -101,39 +215,76 @@ inode_create (disk_sector_t sector, off_t length) {
  * Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (disk_sector_t sector) {
-	struct list_elem *e;
+	struct inode key;
+	struct hash_elem *e;
 	struct inode *inode;
+	bool ok;
 
 	/* Check whether this inode is already open. */
-	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-			e = list_next (e)) {
-		inode = list_entry (e, struct inode, elem);
-		if (inode->sector == sector) {
-			inode_reopen (inode);
-			return inode; 
+	key.sector = sector;
+	lock_acquire (&open_inodes_lock);
+	e = hash_find (&open_inodes, &key.elem);
+	if (e != NULL) {
+		inode = hash_entry (e, struct inode, elem);
+		inode->open_cnt++;
+		while (inode->loading)
+			cond_wait (&inode_loaded, &open_inodes_lock);
+		if (inode->failed) {
+			if (--inode->open_cnt == 0)
+				free_inode (inode);
+			inode = NULL;
 		}
+		lock_release (&open_inodes_lock);
+		return inode;
 	}
 
 	/* Allocate memory. */
-	inode = malloc (sizeof *inode);
-	if (inode == NULL)
+	inode = kmem_cache_alloc (inode_cache);
+	if (inode == NULL) {
+		lock_release (&open_inodes_lock);
 		return NULL;
+	}
 
 	/* Initialize. */
-	list_push_front (&open_inodes, &inode->elem);
 	inode->sector = sector;
 	inode->open_cnt = 1;
+	inode->loading = true;
+	inode->failed = false;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	disk_read (filesys_disk, inode->sector, &inode->data);
+	inode->dir_index = NULL;
+	rwlock_init (&inode->rw, true);
+	hash_insert (&open_inodes, &inode->elem);
+	lock_release (&open_inodes_lock);
+
+	pagecache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	ASSERT (inode->data.magic == INODE_MAGIC);
+	ok = load_extents (inode);
+
+	/* Let anyone waiting for INODE have it.  On failure, the
+	 * last of them frees it. */
+	lock_acquire (&open_inodes_lock);
+	inode->loading = false;
+	cond_broadcast (&inode_loaded, &open_inodes_lock);
+	if (!ok) {
+		inode->failed = true;
+		hash_delete (&open_inodes, &inode->elem);
+		if (--inode->open_cnt == 0)
+			free_inode (inode);
+		inode = NULL;
+	}
+	lock_release (&open_inodes_lock);
 	return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode) {
-	if (inode != NULL)
+	if (inode != NULL) {
+		lock_acquire (&open_inodes_lock);
 		inode->open_cnt++;
+		lock_release (&open_inodes_lock);
+	}
 	return inode;
 }
 
@@ -153,19 +304,31 @@ inode_close (struct inode *inode) {
 		return;
 
 	/* Release resources if this was the last opener. */
-	if (--inode->open_cnt == 0) {
-		/* Remove from inode list and release lock. */
-		list_remove (&inode->elem);
-
-		/* Deallocate blocks if removed. */
-		if (inode->removed) {
-			free_map_release (inode->sector, 1);
-			free_map_release (inode->data.start,
-					bytes_to_sectors (inode->data.length)); 
-		}
+	lock_acquire (&open_inodes_lock);
+	if (--inode->open_cnt > 0) {
+		lock_release (&open_inodes_lock);
+		return;
+	}
 
-		free (inode); 
+	/* Remove from inode table and release lock. */
+	hash_delete (&open_inodes, &inode->elem);
+	lock_release (&open_inodes_lock);
+
+	/* Deallocate blocks if removed. */
+	if (inode->removed) {
+		free_map_release (inode->sector, 1);
+		release_data (inode);
 	}
+	free_inode (inode);
+}
+
+/* Frees INODE's memory. */
+static void
+free_inode (struct inode *inode) {
+	dir_index_destroy (inode->dir_index);
+	free (inode->extents);
+	free (inode->blocks);
+	kmem_cache_free (inode_cache, inode);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -183,8 +346,8 @@ off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	uint8_t *buffer = buffer_;
 	off_t bytes_read = 0;
-	uint8_t *bounce = NULL;
 
+	rwlock_acquire_read (&inode->rw);
 	while (size > 0) {
 		/* Disk sector to read, starting byte offset within sector. */
 		disk_sector_t sector_idx = byte_to_sector (inode, offset);
@@ -200,45 +363,71 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-		} else {
-			/* Read sector into bounce buffer, then partially copy
-			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-			disk_read (filesys_disk, sector_idx, bounce);
-			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-		}
+		/* Read whole sectors that follow one another on disk
+		   together, so that what the cache lacks takes a single
+		   disk command.  Otherwise copy the chunk out of the
+		   buffer cache. */
+		if (sector_ofs == 0 && size >= 2 * DISK_SECTOR_SIZE
+				&& inode_left >= 2 * DISK_SECTOR_SIZE) {
+			off_t left = size < inode_left ? size : inode_left;
+			size_t cnt = sectors_in_run (inode, offset,
+					left / DISK_SECTOR_SIZE);
+
+			chunk_size = cnt * DISK_SECTOR_SIZE;
+			pagecache_read_multiple (sector_idx, cnt, buffer + bytes_read);
+		} else
+			pagecache_read (sector_idx, buffer + bytes_read, sector_ofs,
+					chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
+	rwlock_release_read (&inode->rw);
 
 	return bytes_read;
 }
 
+/* Asks for the sectors holding the SIZE bytes of INODE starting
+ * at OFFSET to be read into the buffer cache in the background.
+ * Sectors past the end of INODE are ignored. */
+void
+inode_readahead (struct inode *inode, off_t offset, off_t size) {
+	off_t pos;
+
+	rwlock_acquire_read (&inode->rw);
+	for (pos = ROUND_DOWN (offset, DISK_SECTOR_SIZE);
+			pos < offset + size && pos < inode_length (inode);
+			pos += DISK_SECTOR_SIZE)
+		pagecache_readahead (byte_to_sector (inode, pos));
+	rwlock_release_read (&inode->rw);
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
  * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+ * less than SIZE if an error occurs.
+ * A write past end of file extends the inode. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		off_t offset) {
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
-	uint8_t *bounce = NULL;
+	bool extend;
+
+	/* Writes within the file only need its layout to hold still.
+	 * Extending it takes exclusive access. */
+	rwlock_acquire_read (&inode->rw);
+	extend = offset + size > inode_length (inode);
+	if (extend) {
+		rwlock_release_read (&inode->rw);
+		rwlock_acquire_write (&inode->rw);
+	}
 
-	if (inode->deny_write_cnt)
-		return 0;
+	if (inode->deny_write_cnt
+			|| (offset + size > inode_length (inode)
+				&& !grow (inode, offset + size)))
+		size = 0;
 
 	while (size > 0) {
 		/* Sector to write, starting byte offset within sector. */
@@ -255,45 +444,224 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-
-			/* If the sector contains data before or after the chunk
-			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
-			else
-				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
-		}
+		/* Copy the chunk into the buffer cache, which reads in the
+		   rest of the sector first if the chunk does not cover it. */
+		pagecache_write (sector_idx, buffer + bytes_written, sector_ofs,
+				chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free (bounce);
 
+	if (extend)
+		rwlock_release_write (&inode->rw);
+	else
+		rwlock_release_read (&inode->rw);
 	return bytes_written;
 }
 
+/* Reads INODE's extents, those in DATA and those in its extent
+ * blocks, into memory.  Returns false if memory allocation
+ * fails. */
+static bool
+load_extents (struct inode *inode) {
+	size_t cnt = inode->data.extent_cnt;
+	size_t i, n;
+	disk_sector_t block;
+
+	inode->extent_cap = cnt > INODE_EXTENTS ? cnt : INODE_EXTENTS;
+	inode->extents = malloc (inode->extent_cap * sizeof *inode->extents);
+	inode->block_cnt = cnt > INODE_EXTENTS
+		? DIV_ROUND_UP (cnt - INODE_EXTENTS, BLOCK_EXTENTS) : 0;
+	inode->blocks = malloc (inode->block_cnt * sizeof *inode->blocks);
+	if (inode->extents == NULL
+			|| (inode->block_cnt > 0 && inode->blocks == NULL)) {
+		free (inode->extents);
+		free (inode->blocks);
+		inode->extents = NULL;
+		inode->blocks = NULL;
+		return false;
+	}
+
+	n = cnt < INODE_EXTENTS ? cnt : INODE_EXTENTS;
+	memcpy (inode->extents, inode->data.extents, n * sizeof *inode->extents);
+
+	/* Copy the rest straight out of the cached extent blocks. */
+	block = inode->data.blocks;
+	for (i = 0; i < inode->block_cnt; i++) {
+		size_t m = cnt - n < BLOCK_EXTENTS ? cnt - n : BLOCK_EXTENTS;
+
+		inode->blocks[i] = block;
+		pagecache_read (block, inode->extents + n,
+				offsetof (struct extent_block, extents),
+				m * sizeof *inode->extents);
+		pagecache_read (block, &block, offsetof (struct extent_block, next),
+				sizeof block);
+		n += m;
+	}
+	return true;
+}
+
+/* Extends INODE to LENGTH bytes, allocating and zeroing new
+ * sectors as needed.  Each run of sectors is allocated right
+ * after the last one if possible, so that a growing file stays
+ * mostly contiguous, but is otherwise taken from anywhere that
+ * has room.  Returns false if memory or disk allocation fails,
+ * in which case INODE keeps any sectors it did get but its
+ * length is unchanged. */
+static bool
+grow (struct inode *inode, off_t length) {
+	static char zeros[DISK_SECTOR_SIZE];
+	size_t need = bytes_to_sectors (length);
+	size_t first = inode->data.extent_cnt;
+	bool success = true;
+	size_t have;
+
+	if (first > 0)
+		first--;
+	while (success && (have = allocated_sectors (inode)) < need) {
+		size_t cnt = need - have;
+		disk_sector_t hint = 0;
+		disk_sector_t start;
+		size_t i;
+
+		if (inode->data.extent_cnt > 0) {
+			struct extent *last = &inode->extents[inode->data.extent_cnt - 1];
+			hint = last->start + last->cnt;
+		}
+
+		/* Take the largest run available, down to a single
+		 * sector. */
+		while (cnt > 0 && !free_map_allocate_near (hint, cnt, &start))
+			cnt /= 2;
+		if (cnt == 0) {
+			success = false;
+			break;
+		}
+
+		for (i = 0; i < cnt; i++)
+			pagecache_write (start + i, zeros, 0, DISK_SECTOR_SIZE);
+		if (!add_extent (inode, start, cnt)) {
+			free_map_release (start, cnt);
+			success = false;
+		}
+	}
+
+	/* Record whatever was allocated, even on failure, so that it
+	 * is not lost. */
+	if (success && length > inode->data.length)
+		inode->data.length = length;
+	return write_extents (inode, first) && success;
+}
+
+/* Appends the CNT sectors starting at START to INODE's data,
+ * merging them into the last extent if they follow it on disk.
+ * Returns false if memory allocation fails. */
+static bool
+add_extent (struct inode *inode, disk_sector_t start, size_t cnt) {
+	size_t ofs = allocated_sectors (inode);
+	struct extent *e;
+
+	if (inode->data.extent_cnt > 0) {
+		e = &inode->extents[inode->data.extent_cnt - 1];
+		if (e->start + e->cnt == start) {
+			e->cnt += cnt;
+			return true;
+		}
+	}
+
+	if (inode->data.extent_cnt == inode->extent_cap) {
+		size_t cap = inode->extent_cap * 2;
+		struct extent *extents = realloc (inode->extents,
+				cap * sizeof *extents);
+		if (extents == NULL)
+			return false;
+		inode->extents = extents;
+		inode->extent_cap = cap;
+	}
+
+	e = &inode->extents[inode->data.extent_cnt++];
+	e->ofs = ofs;
+	e->start = start;
+	e->cnt = cnt;
+	return true;
+}
+
+/* Writes INODE's extents, from index FIRST on, and its inode
+ * sector to disk, allocating extent blocks as needed.  Returns
+ * false if an extent block cannot be allocated. */
+static bool
+write_extents (struct inode *inode, size_t first) {
+	size_t cnt = inode->data.extent_cnt;
+	size_t need = cnt > INODE_EXTENTS
+		? DIV_ROUND_UP (cnt - INODE_EXTENTS, BLOCK_EXTENTS) : 0;
+	size_t i, b;
+
+	/* Allocate any new extent blocks.  The block before the first
+	 * new one has to be rewritten to link to it. */
+	if (need > inode->block_cnt) {
+		disk_sector_t *blocks = realloc (inode->blocks,
+				need * sizeof *blocks);
+		if (blocks == NULL)
+			return false;
+		inode->blocks = blocks;
+		if (inode->block_cnt > 0
+				&& first > INODE_EXTENTS + (inode->block_cnt - 1) * BLOCK_EXTENTS)
+			first = INODE_EXTENTS + (inode->block_cnt - 1) * BLOCK_EXTENTS;
+		while (inode->block_cnt < need) {
+			if (!free_map_allocate (1, &inode->blocks[inode->block_cnt]))
+				return false;
+			inode->block_cnt++;
+		}
+	}
+	inode->data.blocks = inode->block_cnt > 0 ? inode->blocks[0] : 0;
+
+	/* Write extent blocks from the one holding extent FIRST on. */
+	b = first > INODE_EXTENTS ? (first - INODE_EXTENTS) / BLOCK_EXTENTS : 0;
+	for (; b < inode->block_cnt; b++) {
+		size_t ofs = INODE_EXTENTS + b * BLOCK_EXTENTS;
+		size_t n = cnt - ofs < BLOCK_EXTENTS ? cnt - ofs : BLOCK_EXTENTS;
+		disk_sector_t next = b + 1 < inode->block_cnt ? inode->blocks[b + 1] : 0;
+
+		pagecache_write (inode->blocks[b], &next,
+				offsetof (struct extent_block, next), sizeof next);
+		pagecache_write (inode->blocks[b], inode->extents + ofs,
+				offsetof (struct extent_block, extents),
+				n * sizeof *inode->extents);
+	}
+
+	/* Write the inode itself. */
+	for (i = 0; i < cnt && i < INODE_EXTENTS; i++)
+		inode->data.extents[i] = inode->extents[i];
+	pagecache_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	return true;
+}
+
+/* Gives INODE's data sectors and extent blocks back to the free
+ * map. */
+static void
+release_data (struct inode *inode) {
+	size_t i;
+
+	for (i = 0; i < inode->data.extent_cnt; i++)
+		free_map_release (inode->extents[i].start, inode->extents[i].cnt);
+	for (i = 0; i < inode->block_cnt; i++)
+		free_map_release (inode->blocks[i], 1);
+	inode->data.extent_cnt = 0;
+	inode->block_cnt = 0;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 	void
 inode_deny_write (struct inode *inode) 
 {
+	rwlock_acquire_write (&inode->rw);
 	inode->deny_write_cnt++;
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+	rwlock_release_write (&inode->rw);
 }
 
 /* Re-enables writes to INODE.
@@ -301,9 +669,11 @@ inode_deny_write (struct inode *inode)
  * inode_deny_write() on the inode, before closing the inode. */
 void
 inode_allow_write (struct inode *inode) {
+	rwlock_acquire_write (&inode->rw);
 	ASSERT (inode->deny_write_cnt > 0);
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
 	inode->deny_write_cnt--;
+	rwlock_release_write (&inode->rw);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -311,3 +681,31 @@ off_t
 inode_length (const struct inode *inode) {
 	return inode->data.length;
 }
+
+/* Hashes an open inode by sector. */
+static uint64_t
+inode_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+/* Orders open inodes by sector. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct inode, elem)->sector
+		< hash_entry (b, struct inode, elem)->sector;
+}
+
+/* Returns the index directory.c keeps for INODE, or a null
+ * pointer if there is none. */
+struct dir_index *
+inode_get_dir_index (struct inode *inode) {
+	return inode->dir_index;
+}
+
+/* Sets the index directory.c keeps for INODE to INDEX.  It is
+ * freed along with INODE. */
+void
+inode_set_dir_index (struct inode *inode, struct dir_index *index) {
+	inode->dir_index = index;
+}
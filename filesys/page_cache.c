@@ -1,9 +1,126 @@
 /* page_cache.c: Implementation of Page Cache (Buffer Cache). */
 
+#include "filesys/page_cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
+
+/* Buffer cache.
+
+   Every file system sector read or written goes through a cache
+   of CACHE_SIZE sectors, indexed by a hash table on the sector
+   number.  When a sector that is not cached is needed, the clock
+   algorithm picks an entry to replace: the hand sweeps over the
+   entries, giving each one that was used since its last visit a
+   second chance.
+
+   Writes only mark an entry dirty.  A dirty entry reaches the
+   disk when it is evicted, when the worker thread wakes up every
+   FLUSH_INTERVAL milliseconds, or when pagecache_flush() is
+   called, as filesys_done() does.
+
+   Large reads of sectors that lie together on disk go through
+   pagecache_read_multiple(), which reads the sectors the cache
+   lacks straight into the caller's buffer, a run at a time, and
+   does not cache them.  While such a run is being read, it is
+   listed in DIRECT_READS, and cache_get() waits before bringing
+   any of its sectors into the cache.  A write to one of them
+   therefore either made it into the cache before the run was
+   chosen, so that the run stops short of it, or waits until the
+   run has been read, so a read around the cache never misses a
+   write that finished before it returned.
+
+   Sequential readers ask for sectors ahead of their position to
+   be read in with pagecache_readahead(), which queues them for a
+   second worker thread, so that the disk is busy with the next
+   sectors while the reader works on the current ones.
+
+   The cache lock protects the index and the entries' bookkeeping
+   but is not held while data is copied or during disk I/O.
+   Instead, an entry is pinned while it is in use, which keeps it
+   from being evicted, and an entry whose data is not valid yet
+   is marked as loading, which makes anyone else looking it up
+   wait on CACHE_COND. */
+
+/* Number of cached sectors. */
+#define CACHE_SIZE 64
+
+/* Milliseconds between flushes by the worker thread. */
+#define FLUSH_INTERVAL 1000
+
+/* Number of read-ahead requests that can be queued. */
+#define RA_QUEUE_SIZE 32
+
+/* A cached sector. */
+struct cache_entry {
+	disk_sector_t sector;               /* Sector held. */
+	bool in_use;                        /* Holds a sector? */
+	bool loading;                       /* Data not yet valid? */
+	bool dirty;                         /* Newer than the disk? */
+	bool accessed;                      /* Used since clock last passed? */
+	bool prefetched;                    /* Read ahead and not used yet? */
+	int pin_cnt;                        /* Users; nonzero keeps it cached. */
+	uint8_t *data;                      /* DISK_SECTOR_SIZE bytes. */
+	struct hash_elem elem;              /* Element in index. */
+};
+
+static struct cache_entry entries[CACHE_SIZE];
+static struct hash cache_index;        /* Entries in use, by sector. */
+static size_t clock_hand;               /* Next entry the clock visits. */
+static struct lock cache_lock;          /* Protects everything above. */
+static struct condition cache_cond;     /* Signaled when an entry is
+                                           loaded or unpinned. */
+
+/* A run of sectors being read around the cache. */
+struct direct_read {
+	disk_sector_t start;                /* First sector. */
+	size_t cnt;                         /* Number of sectors. */
+	struct list_elem elem;              /* Element in direct_reads. */
+};
+
+/* Runs being read around the cache, also protected by
+   cache_lock. */
+static struct list direct_reads;
+
+/* Read-ahead queue, also protected by cache_lock. */
+static disk_sector_t ra_queue[RA_QUEUE_SIZE];
+static size_t ra_head;                  /* Index of oldest request. */
+static size_t ra_cnt;                   /* Number of requests queued. */
+static struct condition ra_cond;        /* Signaled when one is queued. */
+
+/* Statistics. */
+static unsigned long long hit_cnt;      /* Lookups found in the cache. */
+static unsigned long long miss_cnt;     /* Lookups that were not. */
+static unsigned long long direct_cnt;   /* Sectors read around the cache. */
+static unsigned long long ra_cnt_total; /* Sectors read ahead. */
+static unsigned long long ra_hit_cnt;   /* ...and then used. */
+static unsigned long long ra_waste_cnt; /* ...and evicted unused. */
+
 static bool page_cache_readahead (struct page *page, void *kva);
 static bool page_cache_writeback (struct page *page);
 static void page_cache_destroy (struct page *page);
+static void page_cache_kworkerd (void *aux);
+static void page_cache_readaheadd (void *aux);
+
+static struct cache_entry *cache_get (disk_sector_t, bool read,
+		bool prefetch);
+static void cache_put (struct cache_entry *, bool dirty);
+static struct cache_entry *cache_lookup (disk_sector_t);
+static bool in_direct_read (disk_sector_t);
+static void ra_cancel (disk_sector_t start, size_t cnt);
+static struct cache_entry *cache_evict (void);
+static void cache_write_back (struct cache_entry *);
+static uint64_t entry_hash (const struct hash_elem *, void *);
+static bool entry_less (const struct hash_elem *, const struct hash_elem *,
+		void *);
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations page_cache_op = {
@@ -13,12 +130,366 @@ static const struct page_operations page_cache_op = {
 	.type = VM_PAGE_CACHE,
 };
 
-tid_t page_cache_workerd;
+tid_t page_cache_workerd = TID_ERROR;
+tid_t page_cache_readahead_tid = TID_ERROR;
 
 /* The initializer of file vm */
 void
 pagecache_init (void) {
-	/* TODO: Create a worker daemon for page cache with page_cache_kworkerd */
+	uint8_t *data;
+	size_t i;
+
+	/* Called again by vm_init() in the VM build. */
+	if (page_cache_workerd != TID_ERROR)
+		return;
+
+	data = palloc_get_multiple (PAL_ASSERT,
+			CACHE_SIZE * DISK_SECTOR_SIZE / PGSIZE);
+	for (i = 0; i < CACHE_SIZE; i++) {
+		entries[i].in_use = false;
+		entries[i].data = data + i * DISK_SECTOR_SIZE;
+	}
+	if (!hash_init (&cache_index, entry_hash, entry_less, NULL))
+		PANIC ("buffer cache index creation failed");
+	clock_hand = 0;
+	lock_init (&cache_lock);
+	cond_init (&cache_cond);
+	list_init (&direct_reads);
+	ra_head = ra_cnt = 0;
+	cond_init (&ra_cond);
+
+	page_cache_workerd = thread_create ("kworkerd", PRI_DEFAULT,
+			page_cache_kworkerd, NULL);
+	page_cache_readahead_tid = thread_create ("kreadaheadd", PRI_DEFAULT,
+			page_cache_readaheadd, NULL);
+	if (page_cache_workerd == TID_ERROR
+			|| page_cache_readahead_tid == TID_ERROR)
+		PANIC ("can't start buffer cache workers");
+}
+
+/* Reads SIZE bytes at offset OFS within SECTOR into BUFFER. */
+void
+pagecache_read (disk_sector_t sector, void *buffer, int ofs, int size) {
+	struct cache_entry *e;
+
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	e = cache_get (sector, true, false);
+	memcpy (buffer, e->data + ofs, size);
+	cache_put (e, false);
+}
+
+/* Writes SIZE bytes from BUFFER at offset OFS within SECTOR.
+   Writing a whole sector does not read it from disk first. */
+void
+pagecache_write (disk_sector_t sector, const void *buffer, int ofs, int size) {
+	struct cache_entry *e;
+
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	e = cache_get (sector, size < DISK_SECTOR_SIZE, false);
+	memcpy (e->data + ofs, buffer, size);
+	cache_put (e, true);
+}
+
+/* Reads the CNT sectors starting at SECTOR into BUFFER.  Sectors
+   that are cached are copied out of the cache.  Each run of
+   sectors that are not is read directly into BUFFER with one
+   disk command.  Any of those queued for read-ahead are dropped
+   from the queue, since they have now been read. */
+void
+pagecache_read_multiple (disk_sector_t sector, size_t cnt, void *buffer_) {
+	uint8_t *buffer = buffer_;
+
+	while (cnt > 0) {
+		struct direct_read dr;
+		size_t run;
+
+		lock_acquire (&cache_lock);
+		for (run = 0; run < cnt && cache_lookup (sector + run) == NULL
+				&& !in_direct_read (sector + run); run++)
+			continue;
+		if (run > 0) {
+			dr.start = sector;
+			dr.cnt = run;
+			list_push_back (&direct_reads, &dr.elem);
+			ra_cancel (sector, run);
+			direct_cnt += run;
+		}
+		lock_release (&cache_lock);
+
+		if (run > 0) {
+			disk_read_multiple (filesys_disk, sector, run, buffer);
+
+			lock_acquire (&cache_lock);
+			list_remove (&dr.elem);
+			cond_broadcast (&cache_cond, &cache_lock);
+			lock_release (&cache_lock);
+		} else {
+			pagecache_read (sector, buffer, 0, DISK_SECTOR_SIZE);
+			run = 1;
+		}
+
+		sector += run;
+		buffer += run * DISK_SECTOR_SIZE;
+		cnt -= run;
+	}
+}
+
+/* Asks for SECTOR to be read into the cache in the background,
+   unless it is already there.  Does nothing if too many requests
+   are already waiting. */
+void
+pagecache_readahead (disk_sector_t sector) {
+	lock_acquire (&cache_lock);
+	if (ra_cnt < RA_QUEUE_SIZE && cache_lookup (sector) == NULL
+			&& !in_direct_read (sector)) {
+		ra_queue[(ra_head + ra_cnt++) % RA_QUEUE_SIZE] = sector;
+		cond_signal (&ra_cond, &cache_lock);
+	}
+	lock_release (&cache_lock);
+}
+
+/* Writes every dirty cached sector to disk. */
+void
+pagecache_flush (void) {
+	size_t i;
+
+	lock_acquire (&cache_lock);
+	for (i = 0; i < CACHE_SIZE; i++) {
+		struct cache_entry *e = &entries[i];
+		if (e->in_use && e->dirty && !e->loading)
+			cache_write_back (e);
+	}
+	lock_release (&cache_lock);
+}
+
+/* Prints buffer cache statistics. */
+void
+pagecache_print_stats (void) {
+	if (page_cache_workerd != TID_ERROR) {
+		printf ("Buffer cache: %llu hits, %llu misses, %llu read around\n",
+				hit_cnt, miss_cnt, direct_cnt);
+		printf ("Read-ahead: %llu sectors, %llu used, %llu evicted unused\n",
+				ra_cnt_total, ra_hit_cnt, ra_waste_cnt);
+	}
+}
+
+/* Returns the pinned cache entry for SECTOR, bringing the sector
+   into the cache if necessary.  If READ is false, the caller is
+   going to overwrite the whole sector, so a sector that is not
+   cached is not read from disk; it is kept marked as loading
+   until cache_put().
+
+   If PREFETCH is true, the sector is being read ahead: nothing is
+   done, and a null pointer is returned, if it is already cached. */
+static struct cache_entry *
+cache_get (disk_sector_t sector, bool read, bool prefetch) {
+	struct cache_entry *e;
+
+	lock_acquire (&cache_lock);
+	for (;;) {
+		e = cache_lookup (sector);
+		if (e != NULL) {
+			if (prefetch) {
+				lock_release (&cache_lock);
+				return NULL;
+			}
+			if (e->prefetched) {
+				e->prefetched = false;
+				ra_hit_cnt++;
+			}
+			if (e->loading) {
+				cond_wait (&cache_cond, &cache_lock);
+				continue;
+			}
+			hit_cnt++;
+			break;
+		}
+
+		if (in_direct_read (sector)) {
+			/* Being read around the cache.  Read-ahead has nothing
+			   left to do; anyone else waits for the read to end. */
+			if (prefetch) {
+				lock_release (&cache_lock);
+				return NULL;
+			}
+			cond_wait (&cache_cond, &cache_lock);
+			continue;
+		}
+
+		e = cache_evict ();
+		if (e == NULL) {
+			/* Every entry is busy. */
+			cond_wait (&cache_cond, &cache_lock);
+			continue;
+		}
+		if (e->dirty) {
+			/* Write it back and start over, since anything may
+			   have happened while we did not hold the lock. */
+			cache_write_back (e);
+			continue;
+		}
+
+		/* Take over E for SECTOR. */
+		if (prefetch)
+			ra_cnt_total++;
+		else
+			miss_cnt++;
+		if (e->in_use) {
+			hash_delete (&cache_index, &e->elem);
+			if (e->prefetched)
+				ra_waste_cnt++;
+		}
+		e->prefetched = prefetch;
+		e->sector = sector;
+		e->in_use = true;
+		e->loading = true;
+		e->pin_cnt = 1;
+		hash_insert (&cache_index, &e->elem);
+		lock_release (&cache_lock);
+
+		if (!read)
+			return e;
+		disk_read (filesys_disk, sector, e->data);
+
+		lock_acquire (&cache_lock);
+		e->loading = false;
+		e->accessed = true;
+		cond_broadcast (&cache_cond, &cache_lock);
+		lock_release (&cache_lock);
+		return e;
+	}
+
+	e->pin_cnt++;
+	e->accessed = true;
+	lock_release (&cache_lock);
+	return e;
+}
+
+/* Unpins E, which the caller modified if DIRTY is true. */
+static void
+cache_put (struct cache_entry *e, bool dirty) {
+	bool was_loading;
+
+	lock_acquire (&cache_lock);
+	ASSERT (e->pin_cnt > 0);
+	if (dirty)
+		e->dirty = true;
+	was_loading = e->loading;
+	e->loading = false;
+	e->accessed = true;
+	if (--e->pin_cnt == 0 || was_loading)
+		cond_broadcast (&cache_cond, &cache_lock);
+	lock_release (&cache_lock);
+}
+
+/* Returns the entry holding SECTOR, or a null pointer if there
+   is none. */
+static struct cache_entry *
+cache_lookup (disk_sector_t sector) {
+	struct cache_entry key;
+	struct hash_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+
+	key.sector = sector;
+	e = hash_find (&cache_index, &key.elem);
+	return e != NULL ? hash_entry (e, struct cache_entry, elem) : NULL;
+}
+
+/* Returns true if SECTOR is being read around the cache. */
+static bool
+in_direct_read (disk_sector_t sector) {
+	struct list_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+
+	for (e = list_begin (&direct_reads); e != list_end (&direct_reads);
+			e = list_next (e)) {
+		struct direct_read *dr = list_entry (e, struct direct_read, elem);
+		if (sector >= dr->start && sector - dr->start < dr->cnt)
+			return true;
+	}
+	return false;
+}
+
+/* Removes the CNT sectors starting at START from the read-ahead
+   queue. */
+static void
+ra_cancel (disk_sector_t start, size_t cnt) {
+	size_t i, kept = 0;
+
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+
+	for (i = 0; i < ra_cnt; i++) {
+		disk_sector_t sector = ra_queue[(ra_head + i) % RA_QUEUE_SIZE];
+		if (sector < start || sector - start >= cnt)
+			ra_queue[(ra_head + kept++) % RA_QUEUE_SIZE] = sector;
+	}
+	ra_cnt = kept;
+}
+
+/* Chooses an unpinned entry to replace using the clock algorithm.
+   Returns a null pointer if every entry is pinned. */
+static struct cache_entry *
+cache_evict (void) {
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+
+	/* Two sweeps clear every accessed bit, so if nothing turns
+	   up by then, nothing is evictable. */
+	for (i = 0; i < 2 * CACHE_SIZE; i++) {
+		struct cache_entry *e = &entries[clock_hand];
+
+		clock_hand = (clock_hand + 1) % CACHE_SIZE;
+		if (!e->in_use)
+			return e;
+		if (e->pin_cnt > 0 || e->loading)
+			continue;
+		if (e->accessed)
+			e->accessed = false;
+		else
+			return e;
+	}
+	return NULL;
+}
+
+/* Writes dirty entry E back to disk, keeping it pinned meanwhile.
+   Releases the cache lock during the write. */
+static void
+cache_write_back (struct cache_entry *e) {
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+	ASSERT (e->dirty);
+
+	/* Clear the dirty bit first, so that a write into E while it
+	   is on its way out marks it dirty again. */
+	e->dirty = false;
+	e->pin_cnt++;
+	lock_release (&cache_lock);
+
+	disk_write (filesys_disk, e->sector, e->data);
+
+	lock_acquire (&cache_lock);
+	if (--e->pin_cnt == 0)
+		cond_broadcast (&cache_cond, &cache_lock);
+}
+
+/* Hashes an entry by its sector. */
+static uint64_t
+entry_hash (const struct hash_elem *e_, void *aux UNUSED) {
+	const struct cache_entry *e = hash_entry (e_, struct cache_entry, elem);
+	return hash_int (e->sector);
+}
+
+/* Orders entries by sector. */
+static bool
+entry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct cache_entry *a = hash_entry (a_, struct cache_entry, elem);
+	const struct cache_entry *b = hash_entry (b_, struct cache_entry, elem);
+	return a->sector < b->sector;
 }
 
 /* Initialize the page cache */
@@ -44,7 +515,34 @@ static void
 page_cache_destroy (struct page *page) {
 }
 
-/* Worker thread for page cache */
+/* Read-ahead worker.  Reads the sectors queued by
+   pagecache_readahead() into the cache, oldest first. */
+static void
+page_cache_readaheadd (void *aux UNUSED) {
+	for (;;) {
+		struct cache_entry *e;
+		disk_sector_t sector;
+
+		lock_acquire (&cache_lock);
+		while (ra_cnt == 0)
+			cond_wait (&ra_cond, &cache_lock);
+		sector = ra_queue[ra_head];
+		ra_head = (ra_head + 1) % RA_QUEUE_SIZE;
+		ra_cnt--;
+		lock_release (&cache_lock);
+
+		e = cache_get (sector, true, true);
+		if (e != NULL)
+			cache_put (e, false);
+	}
+}
+
+/* Worker thread for page cache.  Writes dirty sectors back to
+   disk every FLUSH_INTERVAL milliseconds. */
 static void
-page_cache_kworkerd (void *aux) {
+page_cache_kworkerd (void *aux UNUSED) {
+	for (;;) {
+		timer_msleep (FLUSH_INTERVAL);
+		pagecache_flush ();
+	}
 }
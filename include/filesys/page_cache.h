@@ -1,12 +1,20 @@
 #ifndef FILESYS_PAGE_CACHE_H
 #define FILESYS_PAGE_CACHE_H
-#include "vm/vm.h"
+#include "devices/disk.h"
+#include <stdbool.h>
+#include <stddef.h>
 
 struct page;
 enum vm_type;
 
 struct page_cache {};
 
-void page_cache_init (void);
+void pagecache_init (void);
+void pagecache_read (disk_sector_t, void *buffer, int ofs, int size);
+void pagecache_write (disk_sector_t, const void *buffer, int ofs, int size);
+void pagecache_read_multiple (disk_sector_t, size_t cnt, void *buffer);
+void pagecache_readahead (disk_sector_t);
+void pagecache_flush (void);
+void pagecache_print_stats (void);
 bool page_cache_initializer (struct page *page, enum vm_type type, void *kva);
 #endif
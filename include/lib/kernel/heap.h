@@ -0,0 +1,64 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Priority queue.
+ *
+ * This is a pairing heap ordered so that the greatest element,
+ * according to a caller-supplied "less" function, is at the
+ * root.  Insertion is O(1); removing the maximum or an arbitrary
+ * element is O(log n) amortized.
+ *
+ * Like the linked list in list.h, the heap does not use dynamic
+ * allocation.  Each structure that can be in a heap embeds a
+ * struct heap_elem member, and heap_entry() converts a pointer to
+ * that member back into a pointer to the enclosing structure.
+ *
+ * The less function is consulted whenever the heap is modified,
+ * so an element's key must not change while it is in a heap.  To
+ * re-key an element, remove it, change the key, and push it
+ * back. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem {
+	struct heap_elem *child;    /* Leftmost child. */
+	struct heap_elem *next;     /* Next sibling. */
+	struct heap_elem *prev;     /* Previous sibling, or parent if leftmost. */
+};
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+ * the structure that HEAP_ELEM is embedded inside.  Supply the
+ * name of the outer structure STRUCT and the member name MEMBER
+ * of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)           \
+	((STRUCT *) ((uint8_t *) (HEAP_ELEM)                \
+		- offsetof (STRUCT, MEMBER)))
+
+/* Compares the value of two heap elements A and B, given
+ * auxiliary data AUX.  Returns true if A is less than B, or
+ * false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+		const struct heap_elem *b,
+		void *aux);
+
+/* Heap. */
+struct heap {
+	struct heap_elem *root;     /* Greatest element, or null. */
+	size_t size;                /* Number of elements. */
+	heap_less_func *less;       /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `less'. */
+};
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+bool heap_empty (const struct heap *);
+size_t heap_size (const struct heap *);
+
+struct heap_elem *heap_max (const struct heap *);
+void heap_push (struct heap *, struct heap_elem *);
+struct heap_elem *heap_pop_max (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+
+#endif /* lib/kernel/heap.h */
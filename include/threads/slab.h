@@ -0,0 +1,45 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Object constructor, run once on every object of a new slab. */
+typedef void kmem_ctor_func (void *obj);
+
+/* A cache of equally sized kernel objects.  See slab.c. */
+struct kmem_cache {
+	const char *name;           /* Name, for statistics. */
+	size_t obj_size;            /* Object size, rounded up to ALIGN. */
+	size_t align;               /* Object alignment. */
+	size_t obj_offset;          /* Offset of first object in a slab. */
+	size_t objs_per_slab;       /* Number of objects in a slab. */
+	kmem_ctor_func *ctor;       /* Constructor, or null. */
+
+	void *hot;                  /* Most recently freed object, or null. */
+
+	struct lock lock;           /* Protects the lists below. */
+	struct list partial;        /* Slabs with free and used objects. */
+	struct list full;           /* Slabs with no free objects. */
+	struct list empty;          /* Slabs with no used objects. */
+
+	/* Statistics. */
+	size_t slab_cnt;            /* Slabs currently allocated. */
+	size_t in_use;              /* Objects handed out. */
+	size_t peak_in_use;         /* Largest IN_USE so far. */
+	unsigned long long alloc_cnt;   /* Calls to kmem_cache_alloc(). */
+	unsigned long long hot_cnt;     /* ...served by the hot object. */
+
+	struct list_elem elem;      /* Element in list of all caches. */
+};
+
+void kmem_init (void);
+struct kmem_cache *kmem_cache_create (const char *name, size_t size,
+		size_t align, kmem_ctor_func *ctor);
+void *kmem_cache_alloc (struct kmem_cache *);
+void *kmem_cache_zalloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+void kmem_print_stats (void);
+
+#endif /* threads/slab.h */
@@ -1,13 +1,42 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <heap.h>
 #include <list.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Priority-ordered wait queue.
+ *
+ * Elements are kept in descending priority order, FIFO among
+ * equal priorities, so the next one to wake is always at the
+ * front.  The first element of each run of equal priorities is
+ * also linked into HEADS, so that an insertion only walks the
+ * distinct priorities present rather than every waiter. */
+struct waitq {
+	struct list elems;          /* All elements, highest priority first. */
+	struct list heads;          /* First element of each priority. */
+};
+
+/* Element in a struct waitq. */
+struct waitq_elem {
+	struct list_elem elem;      /* Element in waitq->elems. */
+	struct list_elem head_elem; /* Element in waitq->heads, if a head. */
+	struct waitq *queue;        /* Queue this element is in, or null. */
+	int priority;               /* Priority it was queued at. */
+};
+
+/* Converts pointer to wait queue element WAITQ_ELEM into a
+ * pointer to the structure that it is embedded inside. */
+#define waitq_entry(WAITQ_ELEM, STRUCT, MEMBER)         \
+	((STRUCT *) ((uint8_t *) (WAITQ_ELEM)               \
+		- offsetof (STRUCT, MEMBER)))
 
 /* A counting semaphore. */
 struct semaphore {
 	unsigned value;             /* Current value. */
-	struct list waiters;        /* List of waiting threads. */
+	struct waitq waiters;       /* Waiting threads. */
 };
 
 void sema_init (struct semaphore *, unsigned value);
@@ -20,6 +49,10 @@ void sema_self_test (void);
 struct lock {
 	struct thread *holder;      /* Thread holding lock (for debugging). */
 	struct semaphore semaphore; /* Binary semaphore controlling access. */
+
+	/* Project 1 : priority donation */
+	struct heap waiters;        /* Threads blocked on this lock, by priority. */
+	struct heap_elem holder_elem;   /* Element in holder's held_locks. */
 };
 
 void lock_init (struct lock *);
@@ -28,9 +61,46 @@ bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
 
+/* Reader-writer lock.
+ *
+ * Any number of readers, or a single writer, may hold an rwlock
+ * at once.  With PREFER_WRITERS, new readers queue up behind a
+ * blocked writer instead of joining the current readers, so that
+ * writers cannot starve.  A blocked thread donates its priority
+ * to every current holder. */
+struct rwlock {
+	unsigned readers;           /* # of threads holding read access. */
+	struct thread *writer;      /* Thread holding write access, or null. */
+	bool prefer_writers;        /* Hold off new readers while writers wait. */
+	struct list holders;        /* rwlock_hold of each current holder. */
+	struct heap read_waiters;   /* Blocked readers, by priority. */
+	struct heap write_waiters;  /* Blocked writers, by priority. */
+};
+
+/* A thread's hold on an rwlock, kept in struct thread so that
+ * donations can reach all readers. */
+struct rwlock_hold {
+	struct rwlock *rwlock;      /* Held or awaited rwlock, or null. */
+	struct thread *thread;      /* Thread holding or awaiting it. */
+	struct list_elem elem;      /* Element in rwlock->holders. */
+};
+
+/* Maximum number of rwlocks one thread may hold, or be waiting
+ * for, at once.  Acquiring one more is a kernel bug, caught by
+ * an assertion.  The file system nests at most two (a file's
+ * inode, then the free map's). */
+#define RWLOCK_HOLD_MAX 4
+
+void rwlock_init (struct rwlock *, bool prefer_writers);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_by_current_thread (const struct rwlock *);
+
 /* Condition variable. */
 struct condition {
-	struct list waiters;        /* List of waiting threads. */
+	struct waitq waiters;       /* Waiting threads' semaphore_elems. */
 };
 
 void cond_init (struct condition *);
@@ -38,6 +108,8 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+void synch_priority_changed (struct thread *);
+
 /* Optimization barrier.
  *
  * The compiler will not reorder operations across an
@@ -4,6 +4,7 @@
 #include <debug.h>
 #include <list.h>
 #include <stdint.h>
+#include "threads/fixed-point.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"		/* Project 2 : system call */
 #ifdef VM
@@ -28,10 +29,25 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness, for the MLFQS. */
+#define NICE_MIN -20                    /* Nicest. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice. */
+
 /* Project 2 : system call - file descriptor */
 #define FDT_PAGES     3
 #define FDCOUNT_LIMIT FDT_PAGES * (1 << 9)  // 3 * 512 = 1536
 
+/* Log2-bucketed histogram of TSC cycle counts.  Bucket 0 holds
+ * samples below 2^(LAT_SHIFT + 1) cycles, bucket B holds samples
+ * in [2^(LAT_SHIFT + B), 2^(LAT_SHIFT + B + 1)), and the last
+ * bucket also holds everything longer. */
+#define LAT_SHIFT 10
+#define LAT_BUCKETS 16
+struct lat_hist {
+	uint32_t cnt[LAT_BUCKETS];
+};
+
 /* A kernel thread or user process.
  *
  * Each thread structure is stored in its own 4 kB page.  The
@@ -132,10 +148,30 @@ struct thread {
 	int64_t wakeup_tick;
 
 	/* Project 1 : priority-donate*/
-	int original_priority;
-	struct lock *wait_lock;
-	struct list donations;
-	struct list_elem donation_elem;
+	int original_priority;              /* Priority before donations. */
+	struct lock *wait_lock;             /* Lock being waited for, if any. */
+	unsigned wait_seq;                  /* Arrival order among its waiters. */
+	struct heap_elem wait_elem;         /* Element in wait_lock->waiters. */
+	struct heap held_locks;             /* Held locks, by best waiter. */
+	struct rwlock *wait_rwlock;         /* rwlock being waited for, if any. */
+	bool wait_write;                    /* Waiting for write access? */
+	struct rwlock_hold rw_holds[RWLOCK_HOLD_MAX]; /* Held rwlocks. */
+	struct waitq_elem sema_elem;        /* Element in a semaphore's waiters. */
+	struct waitq_elem *cond_elem;       /* Element in a condition's waiters. */
+
+	/* Project 1 : mlfqs */
+	int nice;                           /* Niceness. */
+	fixed_t recent_cpu;                 /* Recent CPU time, decayed. */
+	struct list_elem all_elem;          /* Element in all_list. */
+
+	/* Scheduling latency statistics. */
+	uint64_t ready_stamp;               /* TSC when last made ready. */
+	uint64_t run_stamp;                 /* TSC when last made running. */
+	struct lat_hist wait_hist;          /* Run-queue wait times. */
+	struct lat_hist slice_hist;         /* On-CPU slice lengths. */
+
+	/* Owned by threads/malloc.c. */
+	struct magazine *magazines;         /* Cached free blocks, or null. */
 };
 
 /* If false (default), use round-robin scheduler.
@@ -147,7 +183,9 @@ void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_account_idle (int64_t cnt);
 void thread_print_stats (void);
+void thread_print_latency_stats (void);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
@@ -175,9 +213,13 @@ void do_iret (struct intr_frame *tf);
 
 /* Project 1 */
 bool cmp_priority(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED);
+bool cmp_waiter_priority(const struct heap_elem *a, const struct heap_elem *b, void *aux UNUSED);
 void donate_priority (void);
-void remove_with_lock (struct lock *lock);
+void donation_add (struct lock *lock);
+void donation_add_rwlock (struct rwlock *rw, bool write);
+void donation_remove (struct lock *lock);
 void refresh_priority(void);
+void thread_refresh_priority (struct thread *t);
 void test_max_priority(void);
 
 #endif /* threads/thread.h */
@@ -8,8 +8,6 @@ void syscall_init (void);
 typedef int pid_t;
 #define PID_ERROR ((pid_t)-1)
 
-struct lock filesys_lock;
-
 void check_address (void *addr);
 
 void halt (void);
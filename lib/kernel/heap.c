@@ -0,0 +1,159 @@
+/* Pairing heap.
+
+   See heap.h for basic information.
+
+   Each element's children form a doubly linked sibling list
+   headed by its `child' member.  The leftmost child's `prev'
+   points to the parent rather than to a sibling, which lets an
+   arbitrary element be cut out of the tree in O(1). */
+
+#include "heap.h"
+#include "../debug.h"
+
+static struct heap_elem *meld (struct heap *,
+		struct heap_elem *, struct heap_elem *);
+static struct heap_elem *merge_pairs (struct heap *, struct heap_elem *);
+
+/* Initializes H as an empty heap ordered by LESS, given
+   auxiliary data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux) {
+	ASSERT (h != NULL);
+	ASSERT (less != NULL);
+
+	h->root = NULL;
+	h->size = 0;
+	h->less = less;
+	h->aux = aux;
+}
+
+/* Returns true if H is empty, false otherwise. */
+bool
+heap_empty (const struct heap *h) {
+	return h->root == NULL;
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size (const struct heap *h) {
+	return h->size;
+}
+
+/* Returns the greatest element in H without removing it.
+   Returns a null pointer if H is empty. */
+struct heap_elem *
+heap_max (const struct heap *h) {
+	return h->root;
+}
+
+/* Inserts E into H. */
+void
+heap_push (struct heap *h, struct heap_elem *e) {
+	ASSERT (e != NULL);
+
+	e->child = e->next = e->prev = NULL;
+	h->root = meld (h, h->root, e);
+	h->size++;
+}
+
+/* Removes and returns the greatest element in H, which must not
+   be empty. */
+struct heap_elem *
+heap_pop_max (struct heap *h) {
+	struct heap_elem *max = h->root;
+
+	ASSERT (max != NULL);
+
+	h->root = merge_pairs (h, max->child);
+	h->size--;
+	return max;
+}
+
+/* Removes E, which must be in H, from H. */
+void
+heap_remove (struct heap *h, struct heap_elem *e) {
+	ASSERT (e != NULL);
+	ASSERT (h->size > 0);
+
+	if (e == h->root) {
+		heap_pop_max (h);
+		return;
+	}
+
+	/* Cut E's subtree out of its parent's child list. */
+	if (e->prev->child == e)
+		e->prev->child = e->next;
+	else
+		e->prev->next = e->next;
+	if (e->next != NULL)
+		e->next->prev = e->prev;
+
+	/* Put E's children back into the heap. */
+	h->root = meld (h, h->root, merge_pairs (h, e->child));
+	h->size--;
+}
+
+/* Combines the trees rooted at A and B, either of which may be
+   null, into one and returns its root.  A and B must have no
+   siblings. */
+static struct heap_elem *
+meld (struct heap *h, struct heap_elem *a, struct heap_elem *b) {
+	if (a == NULL)
+		return b;
+	if (b == NULL)
+		return a;
+
+	if (h->less (a, b, h->aux)) {
+		struct heap_elem *t = a;
+		a = b;
+		b = t;
+	}
+
+	/* Make B the leftmost child of A. */
+	b->prev = a;
+	b->next = a->child;
+	if (a->child != NULL)
+		a->child->prev = b;
+	a->child = b;
+	a->prev = a->next = NULL;
+	return a;
+}
+
+/* Combines the sibling list starting at FIRST into a single tree
+   and returns its root, using the standard two-pass scheme:
+   meld siblings in pairs from left to right, then meld the
+   resulting trees from right to left. */
+static struct heap_elem *
+merge_pairs (struct heap *h, struct heap_elem *first) {
+	struct heap_elem *pairs = NULL;
+	struct heap_elem *root = NULL;
+
+	/* First pass.  Melded pairs are stacked through `next', so
+	   the rightmost pair ends up on top. */
+	while (first != NULL) {
+		struct heap_elem *a = first;
+		struct heap_elem *b = a->next;
+		struct heap_elem *m;
+
+		first = b != NULL ? b->next : NULL;
+		a->prev = a->next = NULL;
+		if (b != NULL)
+			b->prev = b->next = NULL;
+
+		m = meld (h, a, b);
+		m->next = pairs;
+		pairs = m;
+	}
+
+	/* Second pass. */
+	while (pairs != NULL) {
+		struct heap_elem *next = pairs->next;
+
+		pairs->next = NULL;
+		root = meld (h, root, pairs);
+		pairs = next;
+	}
+	if (root != NULL)
+		root->prev = root->next = NULL;
+	return root;
+}
@@ -0,0 +1,44 @@
+/* Child process for par-read test.
+   Reads its own test file a sector at a time and checks that the
+   contents are what the parent wrote. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/base/par-read.h"
+
+const char *test_name = "child-par-read";
+
+static char buf[BUF_SIZE];
+
+int
+main (int argc, const char *argv[]) 
+{
+  char file_name[16];
+  char block[512];
+  int child_idx;
+  int fd;
+  size_t ofs;
+
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+  snprintf (file_name, sizeof file_name, FILE_NAME_FMT, child_idx);
+
+  random_init (child_idx);
+  random_bytes (buf, sizeof buf);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (ofs = 0; ofs < sizeof buf; ofs += sizeof block) 
+    {
+      CHECK (read (fd, block, sizeof block) == sizeof block,
+             "read \"%s\"", file_name);
+      compare_bytes (block, buf + ofs, sizeof block, ofs, file_name);
+    }
+  close (fd);
+
+  return child_idx;
+}
@@ -0,0 +1,40 @@
+/* Writes one file per child, then spawns child processes that
+   each read their own file back at the same time, and checks
+   that every child sees its own file's contents.  This is a
+   correctness test for concurrent reads of unrelated files under
+   per-inode locking; user programs have no clock, so it does not
+   measure how much the reads overlap. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/base/par-read.h"
+
+static char buf[BUF_SIZE];
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+  char file_name[16];
+  int fd;
+  int i;
+
+  for (i = 0; i < CHILD_CNT; i++) 
+    {
+      snprintf (file_name, sizeof file_name, FILE_NAME_FMT, i);
+      random_init (i);
+      random_bytes (buf, sizeof buf);
+      CHECK (create (file_name, sizeof buf), "create \"%s\"", file_name);
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+      CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+             "write \"%s\"", file_name);
+      msg ("close \"%s\"", file_name);
+      close (fd);
+    }
+
+  exec_children ("child-par-read", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+}
@@ -0,0 +1,10 @@
+#ifndef TESTS_FILESYS_BASE_PAR_READ_H
+#define TESTS_FILESYS_BASE_PAR_READ_H
+
+#define CHILD_CNT 4
+#define BUF_SIZE (32 * 1024)
+
+/* Name of the file read by child CHILD_IDX. */
+#define FILE_NAME_FMT "data%d"
+
+#endif /* tests/filesys/base/par-read.h */
@@ -0,0 +1,147 @@
+/* Allocates and frees small blocks from many threads at once.
+
+   Each of THREAD_CNT threads keeps SLOT_CNT blocks of
+   pseudo-random sizes live at a time.  On every iteration it
+   picks a slot, checks that the block there still holds the
+   pattern written into it, frees it, and allocates a new block
+   of another size in its place.  Every SWAP_INTERVAL iterations
+   a thread also trades one of its blocks for one left in a
+   shared slot by another thread and yields, so that blocks are
+   regularly freed by a thread other than the one that allocated
+   them and the threads' allocations interleave.
+
+   The elapsed timer ticks vary from run to run, so the .ck file
+   ignores them and only checks that no block was corrupted. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 8
+#define ITER_CNT 20000
+#define SLOT_CNT 32
+#define SWAP_INTERVAL 64
+#define MAX_SIZE 1000
+
+/* A live block and the byte it is filled with. */
+struct slot 
+  {
+    uint8_t *p;
+    size_t size;
+    uint8_t fill;
+  };
+
+static struct slot shared;              /* Block left for another thread. */
+static struct lock shared_lock;         /* Protects SHARED. */
+static struct semaphore done;           /* Upped by each finished thread. */
+static int bad_cnt;                     /* Corrupted blocks found. */
+
+static thread_func stress_thread;
+
+void
+test_malloc_stress (void) 
+{
+  int64_t start_ticks;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  msg ("%d threads, %d iterations each.", THREAD_CNT, ITER_CNT);
+
+  lock_init (&shared_lock);
+  sema_init (&done, 0);
+  shared.p = NULL;
+  bad_cnt = 0;
+
+  /* Run the workers below our own priority, so that all of them
+     exist before the first one starts. */
+  start_ticks = timer_ticks ();
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "stress %d", i);
+      thread_create (name, PRI_DEFAULT - 1, stress_thread, (void *) (intptr_t) i);
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+  msg ("%"PRId64" ticks.", timer_elapsed (start_ticks));
+
+  free (shared.p);
+  if (bad_cnt != 0)
+    fail ("%d corrupted blocks.", bad_cnt);
+  msg ("all blocks intact.");
+}
+
+/* Fills slot S with a new block of SIZE bytes of FILL. */
+static void
+fill_slot (struct slot *s, size_t size, uint8_t fill) 
+{
+  s->p = malloc (size);
+  if (s->p == NULL)
+    fail ("malloc(%zu) failed.", size);
+  s->size = size;
+  s->fill = fill;
+  memset (s->p, fill, size);
+}
+
+/* Checks and frees the block in slot S. */
+static void
+empty_slot (struct slot *s) 
+{
+  size_t i;
+
+  for (i = 0; i < s->size; i++)
+    if (s->p[i] != s->fill)
+      {
+        bad_cnt++;
+        break;
+      }
+  free (s->p);
+  s->p = NULL;
+}
+
+static void
+stress_thread (void *id_) 
+{
+  struct slot slots[SLOT_CNT];
+  unsigned seed = (uintptr_t) id_ * 2654435761u + 1;
+  int i;
+
+  for (i = 0; i < SLOT_CNT; i++)
+    fill_slot (&slots[i], i * MAX_SIZE / SLOT_CNT + 1, i);
+
+  for (i = 0; i < ITER_CNT; i++)
+    {
+      struct slot *s;
+
+      seed = seed * 1103515245 + 12345;
+      s = &slots[(seed >> 16) % SLOT_CNT];
+      empty_slot (s);
+      fill_slot (s, (seed >> 8) % MAX_SIZE + 1, seed);
+
+      if (i % SWAP_INTERVAL == 0)
+        {
+          struct slot tmp;
+
+          lock_acquire (&shared_lock);
+          tmp = shared;
+          shared = *s;
+          *s = tmp;
+          lock_release (&shared_lock);
+          if (s->p == NULL)
+            fill_slot (s, (seed >> 4) % MAX_SIZE + 1, seed >> 4);
+          thread_yield ();
+        }
+    }
+
+  for (i = 0; i < SLOT_CNT; i++)
+    empty_slot (&slots[i]);
+  sema_up (&done);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# Drop the timing line, which differs from run to run.
+@output = grep (!/^\(malloc-stress\) \d+ ticks\.$/, @output);
+compare_output ("run", \@output, [<<'EOF']);
+(malloc-stress) begin
+(malloc-stress) 8 threads, 20000 iterations each.
+(malloc-stress) all blocks intact.
+(malloc-stress) end
+EOF
+pass;
@@ -0,0 +1,85 @@
+/* The main thread and a second reader hold an rwlock for
+   reading when a high-priority writer blocks on it.  Then an
+   even higher-priority reader arrives.  Since the rwlock prefers
+   writers, it must queue up behind the writer rather than join
+   the readers, and donate its priority to both current readers
+   and later to the writer. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+struct rwlock_and_sema 
+  {
+    struct rwlock rwlock;
+    struct semaphore sema;
+  };
+
+static thread_func reader_thread_func;
+static thread_func late_reader_thread_func;
+static thread_func writer_thread_func;
+
+void
+test_rwlock_donate (void) 
+{
+  struct rwlock_and_sema rs;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  rwlock_init (&rs.rwlock, true);
+  sema_init (&rs.sema, 0);
+  rwlock_acquire_read (&rs.rwlock);
+  thread_create ("reader", PRI_DEFAULT + 1, reader_thread_func, &rs);
+  thread_create ("writer", PRI_DEFAULT + 10, writer_thread_func, &rs);
+  thread_create ("late-reader", PRI_DEFAULT + 15,
+                 late_reader_thread_func, &rs);
+  msg ("Main thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 15, thread_get_priority ());
+  sema_up (&rs.sema);
+  msg ("Main thread releasing read lock.");
+  rwlock_release_read (&rs.rwlock);
+  msg ("Main thread finished.");
+}
+
+static void
+reader_thread_func (void *rs_) 
+{
+  struct rwlock_and_sema *rs = rs_;
+
+  rwlock_acquire_read (&rs->rwlock);
+  msg ("Reader acquired read lock.");
+  sema_down (&rs->sema);
+  msg ("Reader should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 15, thread_get_priority ());
+  rwlock_release_read (&rs->rwlock);
+  msg ("Reader finished.");
+}
+
+static void
+late_reader_thread_func (void *rs_) 
+{
+  struct rwlock_and_sema *rs = rs_;
+
+  rwlock_acquire_read (&rs->rwlock);
+  msg ("Late reader acquired read lock.");
+  rwlock_release_read (&rs->rwlock);
+  msg ("Late reader finished.");
+}
+
+static void
+writer_thread_func (void *rs_) 
+{
+  struct rwlock_and_sema *rs = rs_;
+
+  rwlock_acquire_write (&rs->rwlock);
+  msg ("Writer should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 15, thread_get_priority ());
+  rwlock_release_write (&rs->rwlock);
+  msg ("Writer finished.");
+}
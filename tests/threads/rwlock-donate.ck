@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock-donate) begin
+(rwlock-donate) Reader acquired read lock.
+(rwlock-donate) Main thread should have priority 46.  Actual priority: 46.
+(rwlock-donate) Main thread releasing read lock.
+(rwlock-donate) Reader should have priority 46.  Actual priority: 46.
+(rwlock-donate) Writer should have priority 46.  Actual priority: 46.
+(rwlock-donate) Late reader acquired read lock.
+(rwlock-donate) Late reader finished.
+(rwlock-donate) Writer finished.
+(rwlock-donate) Reader finished.
+(rwlock-donate) Main thread finished.
+(rwlock-donate) end
+EOF
+pass;
@@ -0,0 +1,93 @@
+/* Runs N reader threads against one rwlock, for growing N.
+   Each reader sleeps for a while inside its critical section,
+   as it would while waiting for a disk, so readers that are
+   allowed to proceed concurrently all end up inside at once and
+   the elapsed time stays flat as N grows.  For comparison the
+   same workload is then run with writers, which serialize.
+
+   The elapsed ticks vary from run to run, so the .ck file
+   ignores them and only checks how many threads were inside at
+   once. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define MAX_THREAD_CNT 8
+#define HOLD_TICKS 10
+
+struct scaling 
+  {
+    struct rwlock rwlock;
+    struct semaphore done;      /* Upped by each finished thread. */
+    bool write;                 /* Acquire for writing? */
+    int inside;                 /* Threads inside right now. */
+    int max_inside;             /* Most threads inside at once. */
+  };
+
+static thread_func scaling_thread;
+static void run_scaling (int thread_cnt, bool write);
+
+void
+test_rwlock_read_scaling (void) 
+{
+  int n;
+
+  for (n = 1; n <= MAX_THREAD_CNT; n *= 2)
+    run_scaling (n, false);
+  run_scaling (MAX_THREAD_CNT, true);
+}
+
+static void
+run_scaling (int thread_cnt, bool write) 
+{
+  static struct scaling s;
+  const char *kind = write ? "writers" : "readers";
+  int64_t start;
+  int i;
+
+  rwlock_init (&s.rwlock, true);
+  sema_init (&s.done, 0);
+  s.write = write;
+  s.inside = s.max_inside = 0;
+
+  start = timer_ticks ();
+  for (i = 0; i < thread_cnt; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "%c%d", write ? 'w' : 'r', i);
+      thread_create (name, PRI_DEFAULT, scaling_thread, &s);
+    }
+  for (i = 0; i < thread_cnt; i++)
+    sema_down (&s.done);
+
+  msg ("%d %s took %"PRId64" ticks.", thread_cnt, kind,
+       timer_elapsed (start));
+  msg ("%d %s: up to %d inside at once.", thread_cnt, kind, s.max_inside);
+}
+
+static void
+scaling_thread (void *s_) 
+{
+  struct scaling *s = s_;
+
+  if (s->write)
+    rwlock_acquire_write (&s->rwlock);
+  else
+    rwlock_acquire_read (&s->rwlock);
+
+  if (++s->inside > s->max_inside)
+    s->max_inside = s->inside;
+  timer_sleep (HOLD_TICKS);
+  s->inside--;
+
+  if (s->write)
+    rwlock_release_write (&s->rwlock);
+  else
+    rwlock_release_read (&s->rwlock);
+  sema_up (&s->done);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# Drop the timing lines, which differ from run to run.
+@output = grep (!/^\(rwlock-read-scaling\) \d+ \w+ took \d+ ticks\.$/, @output);
+compare_output ("run", \@output, [<<'EOF']);
+(rwlock-read-scaling) begin
+(rwlock-read-scaling) 1 readers: up to 1 inside at once.
+(rwlock-read-scaling) 2 readers: up to 2 inside at once.
+(rwlock-read-scaling) 4 readers: up to 4 inside at once.
+(rwlock-read-scaling) 8 readers: up to 8 inside at once.
+(rwlock-read-scaling) 8 writers: up to 1 inside at once.
+(rwlock-read-scaling) end
+EOF
+pass;
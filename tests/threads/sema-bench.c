@@ -0,0 +1,96 @@
+/* Blocks WAITER_CNT threads of assorted priorities on a single
+   semaphore, then ups it once per waiter.  Each waiter must wake
+   in descending priority order, FIFO among equal priorities, and
+   the cost of each sema_down() and sema_up() should not grow with
+   the number of waiters.
+
+   The timing lines vary from run to run, so the .ck file ignores
+   them and only checks the wakeup order. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+#include "intrinsic.h"
+
+#define WAITER_CNT 2000
+#define PRIORITY_CNT 16
+
+struct waiter 
+  {
+    int id;                     /* Creation order. */
+    int priority;               /* Priority created at. */
+  };
+
+static struct waiter waiters[WAITER_CNT];
+static struct semaphore sema;
+static int wake_order[WAITER_CNT];      /* Waiter IDs, in wakeup order. */
+static int wake_cnt;
+
+static thread_func waiter_thread;
+
+void
+test_sema_bench (void) 
+{
+  uint64_t start;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  msg ("%d waiters at %d priorities.", WAITER_CNT, PRIORITY_CNT);
+  sema_init (&sema, 0);
+
+  /* Each waiter outranks us, so it runs and blocks on SEMA as
+     soon as it is created. */
+  start = rdtsc ();
+  for (i = 0; i < WAITER_CNT; i++)
+    {
+      struct waiter *w = &waiters[i];
+      char name[16];
+
+      w->id = i;
+      w->priority = PRI_DEFAULT + 1 + (i * 7) % PRIORITY_CNT;
+      snprintf (name, sizeof name, "waiter %d", i);
+      thread_create (name, w->priority, waiter_thread, w);
+    }
+  msg ("create and block: %"PRIu64" cycles per waiter.",
+       (rdtsc () - start) / WAITER_CNT);
+
+  /* Each up wakes one waiter, which preempts us, records itself
+     and exits. */
+  start = rdtsc ();
+  for (i = 0; i < WAITER_CNT; i++)
+    sema_up (&sema);
+  msg ("wake and exit: %"PRIu64" cycles per waiter.",
+       (rdtsc () - start) / WAITER_CNT);
+
+  if (wake_cnt != WAITER_CNT)
+    fail ("%d of %d waiters woke up.", wake_cnt, WAITER_CNT);
+  for (i = 1; i < WAITER_CNT; i++)
+    {
+      struct waiter *prev = &waiters[wake_order[i - 1]];
+      struct waiter *cur = &waiters[wake_order[i]];
+
+      if (prev->priority < cur->priority
+          || (prev->priority == cur->priority && prev->id > cur->id))
+        fail ("waiter %d (priority %d) woke after waiter %d (priority %d).",
+              cur->id, cur->priority, prev->id, prev->priority);
+    }
+  msg ("Waiters woke in priority order.");
+}
+
+static void
+waiter_thread (void *w_) 
+{
+  struct waiter *w = w_;
+
+  sema_down (&sema);
+  wake_order[wake_cnt++] = w->id;
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# Drop the timing lines, which differ from run to run.
+@output = grep (!/^\(sema-bench\) .*: \d+ cycles per waiter\.$/, @output);
+compare_output ("run", \@output, [<<'EOF']);
+(sema-bench) begin
+(sema-bench) 2000 waiters at 16 priorities.
+(sema-bench) Waiters woke in priority order.
+(sema-bench) end
+EOF
+pass;
@@ -29,6 +29,10 @@ static const struct test tests[] =
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
     {"priority-condvar", test_priority_condvar},
+    {"rwlock-donate", test_rwlock_donate},
+    {"rwlock-read-scaling", test_rwlock_read_scaling},
+    {"sema-bench", test_sema_bench},
+    {"malloc-stress", test_malloc_stress},
     {"mlfqs-load-1", test_mlfqs_load_1},
     {"mlfqs-load-60", test_mlfqs_load_60},
     {"mlfqs-load-avg", test_mlfqs_load_avg},
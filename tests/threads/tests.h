@@ -23,6 +23,10 @@ extern test_func test_priority_fifo;
 extern test_func test_priority_preempt;
 extern test_func test_priority_sema;
 extern test_func test_priority_condvar;
+extern test_func test_rwlock_donate;
+extern test_func test_rwlock_read_scaling;
+extern test_func test_sema_bench;
+extern test_func test_malloc_stress;
 extern test_func test_mlfqs_load_1;
 extern test_func test_mlfqs_load_60;
 extern test_func test_mlfqs_load_avg;
@@ -20,6 +20,7 @@
 #include "threads/mmu.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -36,6 +37,7 @@
 #include "devices/disk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/page_cache.h"
 #endif
 
 /* Page-map-level-4 with kernel mappings only. */
@@ -85,6 +87,7 @@ main (void) {
 	/* Initialize memory system. */
 	mem_end = palloc_init ();
 	malloc_init ();
+	kmem_init ();
 	paging_init (mem_end);
 
 #ifdef USERPROG
@@ -221,6 +224,12 @@ parse_options (char **argv) {
 			random_init (atoi (value));
 		else if (!strcmp (name, "-mlfqs"))
 			thread_mlfqs = true;
+		else if (!strcmp (name, "-tickless"))
+			timer_tickless = true;
+#ifdef FILESYS
+		else if (!strcmp (name, "-dma"))
+			disk_dma = true;
+#endif
 #ifdef USERPROG
 		else if (!strcmp (name, "-ul"))
 			user_page_limit = atoi (value);
@@ -326,6 +335,10 @@ usage (void) {
 			"  -f                 Format file system disk during startup.\n"
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
+			"  -tickless          Stop the timer tick while the CPU is idle.\n"
+#ifdef FILESYS
+			"  -dma               Use bus-master DMA for disk transfers.\n"
+#endif
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
@@ -354,8 +367,12 @@ static void
 print_stats (void) {
 	timer_print_stats ();
 	thread_print_stats ();
+	thread_print_latency_stats ();
+	palloc_print_stats ();
+	kmem_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
+	pagecache_print_stats ();
 #endif
 	console_print_stats ();
 	kbd_print_stats ();
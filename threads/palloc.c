@@ -24,13 +24,44 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Within a pool, pages are handed out by a binary buddy
+   allocator.  Free memory is kept as blocks of 2**ORDER pages,
+   aligned to their size relative to the pool base, on one free
+   list per order.  A request for N pages takes the smallest
+   large enough block, splitting bigger ones as needed, and gives
+   back the pages past N.  Freeing a block merges it with its
+   buddy, the other half of the next larger block, for as long
+   as that buddy is free too.  Both take O(log n) time, unlike a
+   scan of the whole pool for a run of free pages.
+
+   Each free block keeps its free list element in its own first
+   page, and ORDER_MAP records, for the first page of each free
+   block, the block's order plus 1 (0 for every other page), so
+   that a buddy can be checked in constant time.
+
+   The used_map bitmap is still filled in at boot to find the
+   usable memory, and is kept up to date as a debugging mirror
+   of the buddy state when assertions are enabled. */
+
+/* Largest block order: 2**PALLOC_MAX_ORDER pages, 4 MB. */
+#define PALLOC_MAX_ORDER 10
+
+/* A free block, stored in its own first page. */
+struct free_block {
+	struct list_elem elem;          /* Element in free_lists. */
+};
 
 /* A memory pool. */
 struct pool {
 	struct lock lock;               /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
 	uint8_t *base;                  /* Base of pool. */
+	size_t page_cnt;                /* Number of pages in pool. */
+	uint8_t *order_map;             /* Per page: free block order + 1. */
+	struct list free_lists[PALLOC_MAX_ORDER + 1];   /* Free blocks. */
+	size_t free_cnt;                /* Number of free pages. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -42,6 +73,9 @@ static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static void buddy_populate (struct pool *);
+static size_t buddy_alloc (struct pool *, size_t page_cnt);
+static void buddy_free (struct pool *, size_t page_idx, size_t page_cnt);
 
 /* multiboot info */
 struct multiboot_info {
@@ -250,6 +284,8 @@ palloc_init (void) {
 	printf ("\text_mem: 0x%llx ~ 0x%llx (Usable: %'llu kB)\n",
 		  ext_mem.start, ext_mem.end, ext_mem.size / 1024);
 	populate_pools (&base_mem, &ext_mem);
+	buddy_populate (&kernel_pool);
+	buddy_populate (&user_pool);
 	return ext_mem.end;
 }
 
@@ -264,7 +300,13 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
 
 	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+	size_t page_idx = buddy_alloc (pool, page_cnt);
+#ifndef NDEBUG
+	if (page_idx != BITMAP_ERROR) {
+		ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+		bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+	}
+#endif
 	lock_release (&pool->lock);
 	void *pages;
 
@@ -318,8 +360,13 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 #ifndef NDEBUG
 	memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
+	lock_acquire (&pool->lock);
+#ifndef NDEBUG
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
 	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+#endif
+	buddy_free (pool, page_idx, page_cnt);
+	lock_release (&pool->lock);
 }
 
 /* Frees the page at PAGE. */
@@ -336,15 +383,27 @@ init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
      and subtract it from the pool's size. */
 	uint64_t pgcnt = (end - start) / PGSIZE;
 	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (pgcnt), PGSIZE) * PGSIZE;
+	size_t om_pages = DIV_ROUND_UP (pgcnt, PGSIZE) * PGSIZE;
+	int order;
 
 	lock_init(&p->lock);
 	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
 	p->base = (void *) start;
+	p->page_cnt = pgcnt;
 
 	// Mark all to unusable.
 	bitmap_set_all(p->used_map, true);
 
 	*bm_base += bm_pages;
+
+	// The buddy allocator's order map follows the bitmap.
+	p->order_map = *bm_base;
+	memset (p->order_map, 0, pgcnt);
+	for (order = 0; order <= PALLOC_MAX_ORDER; order++)
+		list_init (&p->free_lists[order]);
+	p->free_cnt = 0;
+
+	*bm_base += om_pages;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -356,3 +415,146 @@ page_from_pool (const struct pool *pool, void *page) {
 	size_t end_page = start_page + bitmap_size (pool->used_map);
 	return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the first page of the block at page index IDX in
+   POOL. */
+static struct free_block *
+block_at (struct pool *pool, size_t idx) {
+	return (struct free_block *) (pool->base + PGSIZE * idx);
+}
+
+/* Returns the smallest order whose blocks hold PAGE_CNT pages. */
+static int
+order_for (size_t page_cnt) {
+	int order = 0;
+
+	while (((size_t) 1 << order) < page_cnt)
+		order++;
+	return order;
+}
+
+/* Adds the free block of order ORDER at page index IDX to POOL,
+   merging it with its buddy as long as the buddy is free. */
+static void
+buddy_free_block (struct pool *pool, size_t idx, int order) {
+	while (order < PALLOC_MAX_ORDER) {
+		size_t buddy = idx ^ ((size_t) 1 << order);
+
+		if (buddy + ((size_t) 1 << order) > pool->page_cnt
+				|| pool->order_map[buddy] != order + 1)
+			break;
+		list_remove (&block_at (pool, buddy)->elem);
+		pool->order_map[buddy] = 0;
+		if (buddy < idx)
+			idx = buddy;
+		order++;
+	}
+	pool->order_map[idx] = order + 1;
+	list_push_front (&pool->free_lists[order], &block_at (pool, idx)->elem);
+}
+
+/* Returns the PAGE_CNT pages starting at page index IDX to POOL,
+   as the largest aligned blocks that cover them. */
+static void
+buddy_free (struct pool *pool, size_t idx, size_t page_cnt) {
+	pool->free_cnt += page_cnt;
+	while (page_cnt > 0) {
+		int order = 0;
+
+		while (order < PALLOC_MAX_ORDER
+				&& (idx & ((size_t) 1 << order)) == 0
+				&& ((size_t) 2 << order) <= page_cnt)
+			order++;
+		buddy_free_block (pool, idx, order);
+		idx += (size_t) 1 << order;
+		page_cnt -= (size_t) 1 << order;
+	}
+}
+
+/* Takes PAGE_CNT contiguous pages out of POOL and returns the
+   index of the first, or BITMAP_ERROR if no free block is large
+   enough. */
+static size_t
+buddy_alloc (struct pool *pool, size_t page_cnt) {
+	int want = order_for (page_cnt);
+	int order;
+	size_t idx;
+
+	if (page_cnt == 0 || want > PALLOC_MAX_ORDER)
+		return BITMAP_ERROR;
+
+	for (order = want; order <= PALLOC_MAX_ORDER; order++)
+		if (!list_empty (&pool->free_lists[order]))
+			break;
+	if (order > PALLOC_MAX_ORDER)
+		return BITMAP_ERROR;
+
+	idx = pg_no (list_pop_front (&pool->free_lists[order])) - pg_no (pool->base);
+	pool->order_map[idx] = 0;
+
+	/* Split off the upper halves we do not need. */
+	while (order > want) {
+		order--;
+		size_t half = idx + ((size_t) 1 << order);
+		pool->order_map[half] = order + 1;
+		list_push_front (&pool->free_lists[order], &block_at (pool, half)->elem);
+	}
+	pool->free_cnt -= (size_t) 1 << want;
+
+	/* Give back the tail of the block past PAGE_CNT. */
+	if (page_cnt < ((size_t) 1 << want))
+		buddy_free (pool, idx + page_cnt, ((size_t) 1 << want) - page_cnt);
+	return idx;
+}
+
+/* Hands every page that populate_pools() marked free in POOL's
+   used_map to the buddy allocator. */
+static void
+buddy_populate (struct pool *pool) {
+	size_t idx = 0;
+
+	while (idx < pool->page_cnt) {
+		size_t end;
+
+		if (bitmap_test (pool->used_map, idx)) {
+			idx++;
+			continue;
+		}
+		end = bitmap_scan (pool->used_map, idx, 1, true);
+		if (end == BITMAP_ERROR)
+			end = pool->page_cnt;
+		buddy_free (pool, idx, end - idx);
+		idx = end;
+	}
+}
+
+/* Prints POOL's free memory by block order, and how fragmented
+   it is: the share of free pages outside the largest free
+   block, which cannot serve one big request. */
+static void
+print_pool_stats (const char *name, struct pool *pool) {
+	size_t largest = 0;
+	int order;
+
+	lock_acquire (&pool->lock);
+	printf ("  %s: %zu of %zu pages free, blocks by order:", name,
+			pool->free_cnt, pool->page_cnt);
+	for (order = 0; order <= PALLOC_MAX_ORDER; order++) {
+		size_t cnt = list_size (&pool->free_lists[order]);
+		printf (" %zu", cnt);
+		if (cnt > 0)
+			largest = (size_t) 1 << order;
+	}
+	printf ("\n  %s: largest free block %zu pages, %zu%% fragmented\n", name,
+			largest, pool->free_cnt != 0
+			? (pool->free_cnt - largest) * 100 / pool->free_cnt : 0);
+	lock_release (&pool->lock);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void) {
+	printf ("Page allocator:\n");
+	print_pool_stats ("kernel pool", &kernel_pool);
+	print_pool_stats ("user pool", &user_pool);
+}
@@ -0,0 +1,325 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Object caches.
+
+   malloc() rounds every request up to a power of two, which
+   wastes up to half of each block on objects whose size falls
+   just past a power of two, such as struct inode.  A cache
+   instead hands out objects of one exact size, carved out of
+   single-page "slabs".
+
+   Each slab starts with a header followed by an array of free
+   list links, one per object, and then the objects themselves.
+   Keeping the links outside the objects means a free object is
+   never written to, so an object returned to its cache keeps
+   whatever state it had.  A cache's constructor therefore runs
+   only once per object, when its slab is created, and callers
+   are expected to free objects in their constructed state.
+
+   Slabs are kept on three lists according to how many of their
+   objects are in use.  Allocation prefers partially used slabs,
+   so that empty slabs can be returned to the page allocator.
+
+   On top of that, each cache holds on to the object freed most
+   recently.  The next allocation takes it back without touching
+   the slab lists or the cache's lock, needing only a brief
+   interrupt-off section; on this uniprocessor kernel that serves
+   the same purpose as a per-CPU cache. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* End of a slab's free list. */
+#define SLAB_END UINT16_MAX
+
+/* Number of empty slabs a cache keeps rather than freeing. */
+#define EMPTY_SLAB_MAX 1
+
+/* Slab header, at the start of each slab's page. */
+struct slab {
+	unsigned magic;             /* Always set to SLAB_MAGIC. */
+	struct kmem_cache *cache;   /* Owning cache. */
+	struct list_elem elem;      /* Element in one of cache's lists. */
+	uint16_t in_use;            /* Number of objects in use. */
+	uint16_t free;              /* Index of first free object. */
+	uint16_t next[];            /* Next free object after each. */
+};
+
+/* All caches, for kmem_print_stats(). */
+static struct list caches;
+
+static struct slab *slab_create (struct kmem_cache *);
+static void *slab_alloc (struct kmem_cache *);
+static void slab_free (struct kmem_cache *, void *);
+static struct slab *obj_to_slab (struct kmem_cache *, void *);
+static void *slab_obj (struct kmem_cache *, struct slab *, size_t idx);
+
+/* Initializes the object cache layer. */
+void
+kmem_init (void) {
+	list_init (&caches);
+}
+
+/* Creates and returns a cache of objects of SIZE bytes, aligned
+   to ALIGN bytes, which must be a power of 2 or 0 for the
+   default.  If CTOR is nonnull, it is run on every object of a
+   new slab.  NAME is used only for statistics and must stay
+   valid.  Panics if memory is not available. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, size_t align,
+		kmem_ctor_func *ctor) {
+	struct kmem_cache *cache;
+	size_t n;
+
+	ASSERT (name != NULL);
+	ASSERT (size > 0);
+	ASSERT (align == 0 || (align & (align - 1)) == 0);
+
+	cache = malloc (sizeof *cache);
+	if (cache == NULL)
+		PANIC ("out of memory creating cache %s", name);
+
+	cache->name = name;
+	cache->align = align != 0 ? align : sizeof (void *);
+	cache->obj_size = ROUND_UP (size, cache->align);
+	cache->ctor = ctor;
+
+	/* Fit as many objects, with their free list links, as
+	   possible into one page. */
+	n = (PGSIZE - sizeof (struct slab)) / (cache->obj_size + sizeof (uint16_t));
+	while (n > 0 && ROUND_UP (sizeof (struct slab) + n * sizeof (uint16_t),
+				cache->align) + n * cache->obj_size > PGSIZE)
+		n--;
+	if (n == 0)
+		PANIC ("cache %s: %zu-byte objects do not fit in a slab",
+				name, cache->obj_size);
+	cache->objs_per_slab = n;
+	cache->obj_offset = ROUND_UP (sizeof (struct slab) + n * sizeof (uint16_t),
+			cache->align);
+
+	cache->hot = NULL;
+	lock_init (&cache->lock);
+	list_init (&cache->partial);
+	list_init (&cache->full);
+	list_init (&cache->empty);
+	cache->slab_cnt = 0;
+	cache->in_use = 0;
+	cache->peak_in_use = 0;
+	cache->alloc_cnt = 0;
+	cache->hot_cnt = 0;
+
+	enum intr_level old_level = intr_disable ();
+	list_push_back (&caches, &cache->elem);
+	intr_set_level (old_level);
+	return cache;
+}
+
+/* Allocates and returns an object from CACHE, or a null pointer
+   if memory is not available.  The object is in the state its
+   last user freed it in or, if it is new, as CACHE's
+   constructor left it. */
+void *
+kmem_cache_alloc (struct kmem_cache *cache) {
+	enum intr_level old_level;
+	void *obj;
+
+	ASSERT (cache != NULL);
+	ASSERT (!intr_context ());
+
+	/* Fast path: take back the hot object. */
+	old_level = intr_disable ();
+	obj = cache->hot;
+	cache->hot = NULL;
+	if (obj != NULL)
+		cache->hot_cnt++;
+	intr_set_level (old_level);
+
+	if (obj == NULL) {
+		lock_acquire (&cache->lock);
+		obj = slab_alloc (cache);
+		lock_release (&cache->lock);
+		if (obj == NULL)
+			return NULL;
+	}
+
+	old_level = intr_disable ();
+	cache->alloc_cnt++;
+	if (++cache->in_use > cache->peak_in_use)
+		cache->peak_in_use = cache->in_use;
+	intr_set_level (old_level);
+	return obj;
+}
+
+/* Like kmem_cache_alloc(), but zeroes the object.  Suits caches
+   without a constructor. */
+void *
+kmem_cache_zalloc (struct kmem_cache *cache) {
+	void *obj = kmem_cache_alloc (cache);
+	if (obj != NULL)
+		memset (obj, 0, cache->obj_size);
+	return obj;
+}
+
+/* Returns OBJ, which must have been allocated from CACHE, to
+   CACHE.  OBJ becomes the hot object, and the previous hot
+   object, if any, goes back to its slab. */
+void
+kmem_cache_free (struct kmem_cache *cache, void *obj) {
+	enum intr_level old_level;
+	void *prev;
+
+	ASSERT (cache != NULL);
+	ASSERT (!intr_context ());
+
+	if (obj == NULL)
+		return;
+	obj_to_slab (cache, obj);
+
+	old_level = intr_disable ();
+	prev = cache->hot;
+	cache->hot = obj;
+	cache->in_use--;
+	intr_set_level (old_level);
+
+	if (prev != NULL) {
+		lock_acquire (&cache->lock);
+		slab_free (cache, prev);
+		lock_release (&cache->lock);
+	}
+}
+
+/* Prints statistics for every cache: how many objects are in
+   use now and at peak, and how much of the memory held in slabs
+   those objects occupy. */
+void
+kmem_print_stats (void) {
+	struct list_elem *e;
+
+	printf ("Slab caches:\n");
+	for (e = list_begin (&caches); e != list_end (&caches); e = list_next (e)) {
+		struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+		size_t held = c->slab_cnt * PGSIZE;
+
+		printf ("  %-8s %4zu B, %2zu/slab: %zu in use (peak %zu), "
+				"%zu slabs, %zu%% used, %llu/%llu allocs hot\n",
+				c->name, c->obj_size, c->objs_per_slab, c->in_use,
+				c->peak_in_use, c->slab_cnt,
+				held != 0 ? c->in_use * c->obj_size * 100 / held : 0,
+				c->hot_cnt, c->alloc_cnt);
+	}
+}
+
+/* Takes a free object out of one of CACHE's slabs, creating a
+   new slab if needed.  Returns a null pointer if memory is not
+   available. */
+static void *
+slab_alloc (struct kmem_cache *cache) {
+	struct slab *slab;
+	size_t idx;
+
+	ASSERT (lock_held_by_current_thread (&cache->lock));
+
+	if (!list_empty (&cache->partial))
+		slab = list_entry (list_front (&cache->partial), struct slab, elem);
+	else if (!list_empty (&cache->empty))
+		slab = list_entry (list_front (&cache->empty), struct slab, elem);
+	else {
+		slab = slab_create (cache);
+		if (slab == NULL)
+			return NULL;
+		list_push_front (&cache->empty, &slab->elem);
+	}
+
+	idx = slab->free;
+	ASSERT (idx != SLAB_END);
+	slab->free = slab->next[idx];
+	slab->in_use++;
+
+	list_remove (&slab->elem);
+	list_push_front (slab->in_use == cache->objs_per_slab
+			? &cache->full : &cache->partial, &slab->elem);
+	return slab_obj (cache, slab, idx);
+}
+
+/* Puts OBJ back on its slab's free list, and gives the slab back
+   to the page allocator if it is now unused and CACHE already
+   has enough empty slabs. */
+static void
+slab_free (struct kmem_cache *cache, void *obj) {
+	struct slab *slab = obj_to_slab (cache, obj);
+	size_t idx = ((uint8_t *) obj - (uint8_t *) slab - cache->obj_offset)
+		/ cache->obj_size;
+
+	ASSERT (lock_held_by_current_thread (&cache->lock));
+	ASSERT (slab->in_use > 0);
+
+	slab->next[idx] = slab->free;
+	slab->free = idx;
+	slab->in_use--;
+
+	list_remove (&slab->elem);
+	if (slab->in_use > 0)
+		list_push_front (&cache->partial, &slab->elem);
+	else if (list_size (&cache->empty) < EMPTY_SLAB_MAX)
+		list_push_front (&cache->empty, &slab->elem);
+	else {
+		slab->magic = 0;
+		palloc_free_page (slab);
+		cache->slab_cnt--;
+	}
+}
+
+/* Allocates a new slab for CACHE and constructs its objects.
+   Returns a null pointer if memory is not available. */
+static struct slab *
+slab_create (struct kmem_cache *cache) {
+	struct slab *slab = palloc_get_page (0);
+	size_t i;
+
+	if (slab == NULL)
+		return NULL;
+
+	slab->magic = SLAB_MAGIC;
+	slab->cache = cache;
+	slab->in_use = 0;
+	slab->free = 0;
+	for (i = 0; i < cache->objs_per_slab; i++) {
+		slab->next[i] = i + 1 < cache->objs_per_slab ? i + 1 : SLAB_END;
+		if (cache->ctor != NULL)
+			cache->ctor (slab_obj (cache, slab, i));
+	}
+	cache->slab_cnt++;
+	return slab;
+}
+
+/* Returns the slab that OBJ, an object of CACHE, is in. */
+static struct slab *
+obj_to_slab (struct kmem_cache *cache, void *obj) {
+	struct slab *slab = pg_round_down (obj);
+
+	/* Check that the slab is valid. */
+	ASSERT (slab->magic == SLAB_MAGIC);
+	ASSERT (slab->cache == cache);
+
+	/* Check that the object is properly aligned for the slab. */
+	ASSERT (pg_ofs (obj) >= cache->obj_offset);
+	ASSERT ((pg_ofs (obj) - cache->obj_offset) % cache->obj_size == 0);
+
+	return slab;
+}
+
+/* Returns the IDX'th object within SLAB. */
+static void *
+slab_obj (struct kmem_cache *cache, struct slab *slab, size_t idx) {
+	ASSERT (idx < cache->objs_per_slab);
+	return (uint8_t *) slab + cache->obj_offset + idx * cache->obj_size;
+}
@@ -32,8 +32,18 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
-bool cmp_donation_priority(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED);
-bool cmp_sema_priority(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED);
+static void waitq_init (struct waitq *);
+static bool waitq_empty (struct waitq *);
+static void waitq_push (struct waitq *, struct waitq_elem *, int priority);
+static struct waitq_elem *waitq_pop (struct waitq *);
+static void waitq_remove (struct waitq *, struct waitq_elem *);
+static void waitq_requeue (struct waitq_elem *, int priority);
+
+/* One semaphore in a list. */
+struct semaphore_elem {
+	struct waitq_elem elem;             /* Element in condition's waiters. */
+	struct semaphore semaphore;         /* This semaphore. */
+};
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -49,7 +59,7 @@ sema_init (struct semaphore *sema, unsigned value) {
 	ASSERT (sema != NULL);
 
 	sema->value = value;
-	list_init (&sema->waiters);
+	waitq_init (&sema->waiters);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -68,13 +78,11 @@ sema_down (struct semaphore *sema) {
 	ASSERT (!intr_context ());
 
 	old_level = intr_disable ();
-	/* Project 1 : priority-sema */
+	/* Project 1 : priority-sema
+	 * 우선순위 순서로 삽입해 두므로 sema_up()은 맨 앞만 깨우면 된다 */
 	while (sema->value == 0) {
-		if(thread_current()->priority != PRI_DEFAULT){
-			list_insert_ordered(&sema->waiters, &thread_current()->elem, cmp_priority, NULL);
-		}else{
-			list_push_back (&sema->waiters, &thread_current ()->elem);
-		}
+		struct thread *curr = thread_current ();
+		waitq_push (&sema->waiters, &curr->sema_elem, curr->priority);
 		thread_block ();
 	}
 	sema->value--;
@@ -117,11 +125,10 @@ sema_up (struct semaphore *sema) {
 	ASSERT (sema != NULL);
 
 	old_level = intr_disable ();
-	if (!list_empty (&sema->waiters)){
+	if (!waitq_empty (&sema->waiters)){
 		/* Project 1 : priority-sema */
-		list_sort(&sema->waiters, cmp_priority, NULL);
-		thread_unblock (list_entry (list_pop_front (&sema->waiters),
-					struct thread, elem));
+		thread_unblock (waitq_entry (waitq_pop (&sema->waiters),
+					struct thread, sema_elem));
 	}
 	sema->value++;
 	test_max_priority();
@@ -184,6 +191,7 @@ lock_init (struct lock *lock) {
 
 	lock->holder = NULL;
 	sema_init (&lock->semaphore, 1);
+	heap_init (&lock->waiters, cmp_waiter_priority, NULL);
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -197,8 +205,9 @@ lock_init (struct lock *lock) {
 
 /* Project 1 - priority donate */
 /* Priority Donate : 
- * - lock holder가 존재하면, 기부 리스트에 추가한다
- * - donate_priority 수행하여 락을 획득하고, 락의 소유자를 갱신한다. */
+ * - lock holder가 존재하면, 락의 waiters heap에 들어가 holder에게 기부한다
+ * - 락을 획득하면 waiters heap에서 빠지고, 락을 held_locks에 넣어
+ *   남은 대기자들의 기부를 이어받는다. */
 void
 lock_acquire (struct lock *lock) {
 	ASSERT (lock != NULL);
@@ -208,17 +217,21 @@ lock_acquire (struct lock *lock) {
 	enum intr_level old_level = intr_disable();
 	struct thread *curr = thread_current();
 
-	/* Project 1 - priority donate */
-	if(lock->holder != NULL){
-		curr->wait_lock = lock;
-		list_insert_ordered(&lock->holder->donations, &curr->donation_elem, cmp_donation_priority, NULL);
-		// list_push_back(&lock->holder->donations, &curr->donation_elem);
-		donate_priority();
-	}
+	/* Project 1 - priority donate
+	 * mlfqs에서는 우선순위 기부를 하지 않는다 */
+	if(lock->holder != NULL && !thread_mlfqs)
+		donation_add(lock);
 
 	sema_down (&lock->semaphore);		// 락 요청
-	curr->wait_lock = NULL;				// 락 대기자 리스트에서 제거
+	if(curr->wait_lock != NULL){		// 락 대기자 heap에서 제거
+		heap_remove(&lock->waiters, &curr->wait_elem);
+		curr->wait_lock = NULL;
+	}
 	lock->holder = curr;				// 락 부여 후 holder 설정
+	if(!thread_mlfqs){
+		heap_push(&curr->held_locks, &lock->holder_elem);
+		refresh_priority();
+	}
 	intr_set_level(old_level);
 }
 
@@ -230,14 +243,22 @@ lock_acquire (struct lock *lock) {
    interrupt handler. */
 bool
 lock_try_acquire (struct lock *lock) {
+	enum intr_level old_level;
 	bool success;
 
 	ASSERT (lock != NULL);
 	ASSERT (!lock_held_by_current_thread (lock));
 
+	old_level = intr_disable ();
 	success = sema_try_down (&lock->semaphore);
-	if (success)
+	if (success) {
 		lock->holder = thread_current ();
+		if (!thread_mlfqs) {
+			heap_push (&lock->holder->held_locks, &lock->holder_elem);
+			refresh_priority ();
+		}
+	}
+	intr_set_level (old_level);
 	return success;
 }
 
@@ -249,7 +270,8 @@ lock_try_acquire (struct lock *lock) {
    handler. */
 
 /* Donate list Modify :
- * - donations list에서 스레드를 제거하고 우선순위를 원복한다 */
+ * - held_locks에서 락을 제거하고 우선순위를 원복한다
+ * - sema_up()이 더 높은 우선순위 스레드를 깨운 경우에만 양보한다 */
 void
 lock_release (struct lock *lock) {
 	ASSERT (lock != NULL);
@@ -257,13 +279,12 @@ lock_release (struct lock *lock) {
 
 	enum intr_level old_level = intr_disable();
 
-	remove_with_lock(lock);
-	refresh_priority();
+	if(!thread_mlfqs)
+		donation_remove(lock);
 
 	lock->holder = NULL;
 
 	sema_up (&lock->semaphore);
-	thread_yield();
 	intr_set_level(old_level);
 }
 
@@ -277,11 +298,202 @@ lock_held_by_current_thread (const struct lock *lock) {
 	return lock->holder == thread_current ();
 }
 
-/* One semaphore in a list. */
-struct semaphore_elem {
-	struct list_elem elem;              /* List element. */
-	struct semaphore semaphore;         /* This semaphore. */
-};
+static struct rwlock_hold *rwlock_hold_find (struct thread *,
+		const struct rwlock *);
+static void rwlock_grant (struct rwlock *);
+static void rwlock_release (struct rwlock *);
+
+/* Initializes RW.  If PREFER_WRITERS is true, a blocked writer
+   keeps new readers out, so that a steady stream of readers
+   cannot starve it. */
+void
+rwlock_init (struct rwlock *rw, bool prefer_writers) {
+	ASSERT (rw != NULL);
+
+	rw->readers = 0;
+	rw->writer = NULL;
+	rw->prefer_writers = prefer_writers;
+	list_init (&rw->holders);
+	heap_init (&rw->read_waiters, cmp_waiter_priority, NULL);
+	heap_init (&rw->write_waiters, cmp_waiter_priority, NULL);
+}
+
+/* Acquires RW for reading, sleeping until no writer holds it
+   and, with writer preference, none is waiting.  The current
+   thread must not already hold RW.  It may hold at most
+   RWLOCK_HOLD_MAX - 1 other rwlocks.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw) {
+	struct thread *curr = thread_current ();
+	struct rwlock_hold *hold;
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+	ASSERT (!rwlock_held_by_current_thread (rw));
+
+	old_level = intr_disable ();
+	hold = rwlock_hold_find (curr, NULL);
+	ASSERT (hold != NULL);
+	hold->rwlock = rw;
+	hold->thread = curr;
+	if (rw->writer != NULL
+			|| (rw->prefer_writers && !heap_empty (&rw->write_waiters))) {
+		/* rwlock_grant() adds us to the readers. */
+		donation_add_rwlock (rw, false);
+		thread_block ();
+	} else {
+		rw->readers++;
+		list_push_back (&rw->holders, &hold->elem);
+	}
+	refresh_priority ();
+	intr_set_level (old_level);
+}
+
+/* Releases read access to RW, which the current thread must
+   hold for reading. */
+void
+rwlock_release_read (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+	ASSERT (rw->readers > 0);
+	ASSERT (rwlock_held_by_current_thread (rw));
+
+	rwlock_release (rw);
+}
+
+/* Acquires RW for writing, sleeping until no other thread holds
+   it.  The current thread must not already hold RW.  It may hold at most
+   RWLOCK_HOLD_MAX - 1 other rwlocks.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw) {
+	struct thread *curr = thread_current ();
+	struct rwlock_hold *hold;
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+	ASSERT (!rwlock_held_by_current_thread (rw));
+
+	old_level = intr_disable ();
+	hold = rwlock_hold_find (curr, NULL);
+	ASSERT (hold != NULL);
+	hold->rwlock = rw;
+	hold->thread = curr;
+	if (rw->writer != NULL || rw->readers > 0) {
+		/* rwlock_grant() makes us the writer. */
+		donation_add_rwlock (rw, true);
+		thread_block ();
+	} else {
+		rw->writer = curr;
+		list_push_back (&rw->holders, &hold->elem);
+	}
+	refresh_priority ();
+	intr_set_level (old_level);
+}
+
+/* Releases write access to RW, which the current thread must
+   hold for writing. */
+void
+rwlock_release_write (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+	ASSERT (rw->writer == thread_current ());
+
+	rwlock_release (rw);
+}
+
+/* Returns true if the current thread holds RW for reading or
+   writing, false otherwise. */
+bool
+rwlock_held_by_current_thread (const struct rwlock *rw) {
+	struct thread *curr = thread_current ();
+
+	ASSERT (rw != NULL);
+
+	return rwlock_hold_find (curr, rw) != NULL && curr->wait_rwlock != rw;
+}
+
+/* Returns T's rw_holds slot for RW, or null if there is none.
+   With RW null, returns a free slot, or null if T already holds
+   RWLOCK_HOLD_MAX rwlocks. */
+static struct rwlock_hold *
+rwlock_hold_find (struct thread *t, const struct rwlock *rw) {
+	int i;
+
+	for (i = 0; i < RWLOCK_HOLD_MAX; i++)
+		if (t->rw_holds[i].rwlock == rw)
+			return &t->rw_holds[i];
+	return NULL;
+}
+
+/* Drops the current thread's hold on RW and hands RW to the
+   threads waiting for it, if it is now free for them. */
+static void
+rwlock_release (struct rwlock *rw) {
+	struct thread *curr = thread_current ();
+	struct rwlock_hold *hold = rwlock_hold_find (curr, rw);
+	enum intr_level old_level;
+
+	old_level = intr_disable ();
+	list_remove (&hold->elem);
+	hold->rwlock = NULL;
+	if (rw->writer == curr)
+		rw->writer = NULL;
+	else
+		rw->readers--;
+	refresh_priority ();
+	rwlock_grant (rw);
+	test_max_priority ();
+	intr_set_level (old_level);
+}
+
+/* Wakes up the threads that may now hold RW: the best writer if
+   RW is free and a writer goes next, otherwise every blocked
+   reader.  A writer goes next when writers are preferred, or
+   when it outranks every blocked reader.  Ownership is handed
+   over here, before the woken threads run, so that no other
+   thread can slip in between. */
+static void
+rwlock_grant (struct rwlock *rw) {
+	bool writer_next;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (rw->writer != NULL)
+		return;
+
+	writer_next = !heap_empty (&rw->write_waiters)
+		&& (rw->prefer_writers || heap_empty (&rw->read_waiters)
+				|| !cmp_waiter_priority (heap_max (&rw->write_waiters),
+					heap_max (&rw->read_waiters), NULL));
+	if (writer_next) {
+		if (rw->readers == 0) {
+			struct thread *t = heap_entry (heap_pop_max (&rw->write_waiters),
+					struct thread, wait_elem);
+			t->wait_rwlock = NULL;
+			rw->writer = t;
+			list_push_back (&rw->holders, &rwlock_hold_find (t, rw)->elem);
+			thread_refresh_priority (t);
+			thread_unblock (t);
+		}
+		return;
+	}
+
+	while (!heap_empty (&rw->read_waiters)) {
+		struct thread *t = heap_entry (heap_pop_max (&rw->read_waiters),
+				struct thread, wait_elem);
+		t->wait_rwlock = NULL;
+		rw->readers++;
+		list_push_back (&rw->holders, &rwlock_hold_find (t, rw)->elem);
+		thread_refresh_priority (t);
+		thread_unblock (t);
+	}
+}
 
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
@@ -290,7 +502,7 @@ void
 cond_init (struct condition *cond) {
 	ASSERT (cond != NULL);
 
-	list_init (&cond->waiters);
+	waitq_init (&cond->waiters);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -316,6 +528,8 @@ cond_init (struct condition *cond) {
 void
 cond_wait (struct condition *cond, struct lock *lock) {
 	struct semaphore_elem waiter;
+	struct thread *curr = thread_current ();
+	enum intr_level old_level;
 
 	ASSERT (cond != NULL);
 	ASSERT (lock != NULL);
@@ -323,11 +537,16 @@ cond_wait (struct condition *cond, struct lock *lock) {
 	ASSERT (lock_held_by_current_thread (lock));
 
 	sema_init (&waiter.semaphore, 0);
-	/* Project 1 : priority-condvar */
-	// list_push_back (&cond->waiters, &waiter.elem);
-	list_insert_ordered(&cond->waiters, &waiter.elem, cmp_sema_priority, NULL);
+	/* Project 1 : priority-condvar
+	 * 우선순위가 바뀌면 synch_priority_changed()가 위치를 옮긴다 */
+	waiter.elem.queue = NULL;
+	old_level = intr_disable ();
+	waitq_push (&cond->waiters, &waiter.elem, curr->priority);
+	curr->cond_elem = &waiter.elem;
+	intr_set_level (old_level);
 	lock_release (lock);
 	sema_down (&waiter.semaphore);
+	curr->cond_elem = NULL;
 	lock_acquire (lock);
 }
 
@@ -345,10 +564,13 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED) {
 	ASSERT (!intr_context ());
 	ASSERT (lock_held_by_current_thread (lock));
 
-	if (!list_empty (&cond->waiters)){
+	if (!waitq_empty (&cond->waiters)){
 		/* Project 1 : priority-condvar */
-		list_sort(&cond->waiters, cmp_sema_priority, NULL);
-		sema_up (&list_entry (list_pop_front (&cond->waiters), struct semaphore_elem, elem)->semaphore);
+		enum intr_level old_level = intr_disable ();
+		struct semaphore_elem *waiter = waitq_entry (waitq_pop (&cond->waiters),
+				struct semaphore_elem, elem);
+		intr_set_level (old_level);
+		sema_up (&waiter->semaphore);
 	}
 }
 
@@ -363,36 +585,115 @@ cond_broadcast (struct condition *cond, struct lock *lock) {
 	ASSERT (cond != NULL);
 	ASSERT (lock != NULL);
 
-	while (!list_empty (&cond->waiters))
+	while (!waitq_empty (&cond->waiters))
 		cond_signal (cond, lock);
 }
 
-bool
-cmp_donation_priority(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED){
-	struct thread *t_a = list_entry(a, struct thread, donation_elem);
-	struct thread *t_b = list_entry(b, struct thread, donation_elem);
-
-	if(t_a->priority == t_b->priority){
-		return t_a->tid < t_b->tid;
-	}else{
-		return t_a->priority > t_b->priority;
+/* Moves E, if it is queued, behind the elements of PRIORITY. */
+static void
+waitq_requeue (struct waitq_elem *e, int priority) {
+	if (e->queue != NULL && e->priority != priority) {
+		struct waitq *q = e->queue;
+
+		waitq_remove (q, e);
+		waitq_push (q, e, priority);
 	}
 }
 
-/* Project 1 : priority-condvar */
-/* Sema waiters list 정렬
- * - waiters 리스트에 우선순위를 기준으로 삽입될 수 있도록 비교하는 함수를 구현한다
- * - 만약 waiters 리스트에 아무것도 없는 경우를 위한 if 분기문을 추가하여, 커널 패닉을 방지한다 */
-bool
-cmp_sema_priority(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED){
-	struct semaphore_elem *sa = list_entry(a, struct semaphore_elem, elem);
-	struct semaphore_elem *sb = list_entry(b, struct semaphore_elem, elem);
+/* Re-queues T, whose priority just changed, in the semaphore
+   and condition variable it is waiting on, if any, so that they
+   stay in priority order.  A thread in cond_wait() is in both:
+   the condition's waiters and its own semaphore's. */
+void
+synch_priority_changed (struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	waitq_requeue (&t->sema_elem, t->priority);
+	if (t->cond_elem != NULL)
+		waitq_requeue (t->cond_elem, t->priority);
+}
+
+/* Initializes Q as an empty wait queue. */
+static void
+waitq_init (struct waitq *q) {
+	list_init (&q->elems);
+	list_init (&q->heads);
+}
+
+/* Returns true if Q has no elements. */
+static bool
+waitq_empty (struct waitq *q) {
+	return list_empty (&q->elems);
+}
+
+/* Returns true if E heads the run of its priority in its queue. */
+static bool
+waitq_is_head (const struct waitq_elem *e) {
+	return e->head_elem.next != NULL;
+}
+
+/* Inserts E into Q at PRIORITY, behind every element of the same
+   or higher priority.  Takes time proportional to the number of
+   distinct priorities in Q, at most PRI_MAX + 1. */
+static void
+waitq_push (struct waitq *q, struct waitq_elem *e, int priority) {
+	struct list_elem *h;
 
-	if (list_empty(&sa->semaphore.waiters))	return false;
-	if (list_empty(&sb->semaphore.waiters))	return true;
+	ASSERT (e->queue == NULL);
 
-	struct thread *ta = list_entry(list_front(&sa->semaphore.waiters), struct thread, elem);
-	struct thread *tb = list_entry(list_front(&sb->semaphore.waiters), struct thread, elem);
+	e->queue = q;
+	e->priority = priority;
+	for (h = list_begin (&q->heads); h != list_end (&q->heads); h = list_next (h)) {
+		struct waitq_elem *head = list_entry (h, struct waitq_elem, head_elem);
 
-	return ta->priority > tb->priority;
-}
\ No newline at end of file
+		if (head->priority < priority) {
+			/* First element at PRIORITY: start a new run. */
+			list_insert (&head->elem, &e->elem);
+			list_insert (&head->head_elem, &e->head_elem);
+			return;
+		}
+		if (head->priority == priority) {
+			/* Join the run, just before the next one begins. */
+			struct list_elem *next = list_next (h);
+			list_insert (next != list_end (&q->heads)
+					? &list_entry (next, struct waitq_elem, head_elem)->elem
+					: list_end (&q->elems), &e->elem);
+			e->head_elem.prev = e->head_elem.next = NULL;
+			return;
+		}
+	}
+	list_push_back (&q->elems, &e->elem);
+	list_push_back (&q->heads, &e->head_elem);
+}
+
+/* Removes and returns the highest-priority element of Q, which
+   must not be empty.  Runs in constant time. */
+static struct waitq_elem *
+waitq_pop (struct waitq *q) {
+	struct waitq_elem *e = list_entry (list_front (&q->elems),
+			struct waitq_elem, elem);
+
+	waitq_remove (q, e);
+	return e;
+}
+
+/* Removes E from Q in constant time.  If E heads its run, the
+   next element of the same priority takes its place. */
+static void
+waitq_remove (struct waitq *q, struct waitq_elem *e) {
+	ASSERT (e->queue == q);
+
+	if (waitq_is_head (e)) {
+		struct list_elem *next = list_next (&e->elem);
+
+		if (next != list_end (&q->elems)) {
+			struct waitq_elem *n = list_entry (next, struct waitq_elem, elem);
+			if (n->priority == e->priority)
+				list_insert (&e->head_elem, &n->head_elem);
+		}
+		list_remove (&e->head_elem);
+		e->head_elem.prev = e->head_elem.next = NULL;
+	}
+	list_remove (&e->elem);
+	e->queue = NULL;
+}
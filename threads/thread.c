@@ -1,12 +1,15 @@
 #include "threads/thread.h"
 #include <debug.h>
+#include <inttypes.h>
 #include <stddef.h>
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -24,9 +27,21 @@
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running.  There is one FIFO queue
+   per priority level, and bit N of ready_mask is set iff
+   ready_queues[N] is nonempty, so finding the highest runnable
+   priority is a single bit scan no matter how many threads are
+   ready. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_mask;
+
+/* Number of threads in the ready queues. */
+static size_t ready_cnt;
+
+/* All live threads except the one being destroyed, so that the
+   MLFQS can visit them once per second. */
+static struct list all_list;
 
 /* Idle thread. */
 static struct thread *idle_thread;
@@ -44,6 +59,8 @@ static struct list destruction_req;
 static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
+static struct lat_hist wait_hist;   /* System-wide run-queue waits. */
+static struct lat_hist slice_hist;  /* System-wide on-CPU slices. */
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
@@ -54,6 +71,11 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* MLFQS system load average, and the second of uptime it was last
+   updated for. */
+static fixed_t load_avg;
+static int64_t load_avg_second;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -63,6 +85,22 @@ static void do_schedule(int status);
 static void schedule (void);
 static tid_t allocate_tid (void);
 
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static struct thread *ready_pop (void);
+static int ready_max_priority (void);
+static void set_effective_priority (struct thread *, int priority);
+static int lock_priority (const struct lock *);
+static int effective_priority (const struct thread *);
+static void change_donated_priority (struct thread *, int priority);
+static void donate_from (struct thread *, int depth);
+static void donate_to (struct thread *, int depth);
+static bool cmp_lock_priority (const struct heap_elem *, const struct heap_elem *, void *aux);
+static int mlfqs_priority (const struct thread *);
+static void mlfqs_update_second (void);
+static void lat_record (struct lat_hist *, struct lat_hist *, uint64_t cycles);
+static void lat_print (const char *label, const struct lat_hist *);
+
 bool cmp_priority(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED);
 
 /* Returns true if T appears to point to a valid thread. */
@@ -109,14 +147,20 @@ thread_init (void) {
 
 	/* Init the global thread context */
 	lock_init (&tid_lock);
-	list_init (&ready_list);
+	for (int i = PRI_MIN; i <= PRI_MAX; i++)
+		list_init (&ready_queues[i]);
+	ready_mask = 0;
+	ready_cnt = 0;
 	list_init (&destruction_req);
+	list_init (&all_list);
+	load_avg = 0;
 
 	/* Set up a thread structure for the running thread. */
 	initial_thread = running_thread ();
 	init_thread (initial_thread, "main", PRI_DEFAULT);
 	initial_thread->status = THREAD_RUNNING;
 	initial_thread->tid = allocate_tid ();
+	initial_thread->run_stamp = rdtsc ();
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -151,11 +195,35 @@ thread_tick (void) {
 	else
 		kernel_ticks++;
 
+	/* Project 1 : mlfqs */
+	if (thread_mlfqs) {
+		int64_t second = timer_ticks () / TIMER_FREQ;
+
+		if (t != idle_thread)
+			t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+		if (second != load_avg_second) {
+			load_avg_second = second;
+			mlfqs_update_second ();
+		}
+		if (t != idle_thread && timer_ticks () % 4 == 0) {
+			set_effective_priority (t, mlfqs_priority (t));
+			if (t->priority < ready_max_priority ())
+				intr_yield_on_return ();
+		}
+	}
+
 	/* Enforce preemption. */
 	if (++thread_ticks >= TIME_SLICE)
 		intr_yield_on_return ();
 }
 
+/* Accounts for CNT timer ticks that went by without a timer
+   interrupt while the idle thread had the CPU halted. */
+void
+thread_account_idle (int64_t cnt) {
+	idle_ticks += cnt;
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void) {
@@ -163,6 +231,26 @@ thread_print_stats (void) {
 			idle_ticks, kernel_ticks, user_ticks);
 }
 
+/* Prints the system-wide scheduling latency histograms, then
+   those of every live thread that has been scheduled. */
+void
+thread_print_latency_stats (void) {
+	struct list_elem *e;
+
+	printf ("Scheduler latency (TSC cycles, log2 buckets):\n");
+	lat_print ("  all  run-queue wait", &wait_hist);
+	lat_print ("  all  on-CPU slice  ", &slice_hist);
+	for (e = list_begin (&all_list); e != list_end (&all_list); e = list_next (e)) {
+		struct thread *t = list_entry (e, struct thread, all_elem);
+		char label[48];
+
+		snprintf (label, sizeof label, "  %s (tid %d) wait", t->name, t->tid);
+		lat_print (label, &t->wait_hist);
+		snprintf (label, sizeof label, "  %s (tid %d) slice", t->name, t->tid);
+		lat_print (label, &t->slice_hist);
+	}
+}
+
 /* Creates a new kernel thread named NAME with the given initial
    PRIORITY, which executes FUNCTION passing AUX as the argument,
    and adds it to the ready queue.  Returns the thread identifier
@@ -266,13 +354,9 @@ thread_unblock (struct thread *t) {
 	ASSERT (t->status == THREAD_BLOCKED);
 
 	/* Project 1 : priority */
-	list_insert_ordered(&ready_list, &t->elem, cmp_priority, NULL);
-	
-	t->status = THREAD_READY;
-  
-	// list_push_back (&ready_list, &t->elem);
-	list_insert_ordered(&ready_list, &t->elem, cmp_priority, NULL);
+	ready_push (t);
 	t->status = THREAD_READY;
+	t->ready_stamp = rdtsc ();
 
 	intr_set_level (old_level);
 }
@@ -316,10 +400,12 @@ thread_exit (void) {
 #ifdef USERPROG
 	process_exit ();
 #endif
+	malloc_thread_exit ();
 
 	/* Just set our status to dying and schedule another process.
 	   We will be destroyed during the call to schedule_tail(). */
 	intr_disable ();
+	list_remove (&thread_current ()->all_elem);
 	do_schedule (THREAD_DYING);
 	NOT_REACHED ();
 }
@@ -334,53 +420,32 @@ thread_yield (void) {
 	ASSERT (!intr_context ());		// Do Not yield in interrupt context
 
 	/* Project 2 : args 에러 방어 코드 추가 */
-	if(list_empty(&ready_list))
+	if(ready_mask == 0)
 		return;
   
 	old_level = intr_disable ();	// Disable interrupt to protect critical section
-	if (curr != idle_thread)
-		// list_push_back (&ready_list, &curr->elem);
-		list_insert_ordered(&ready_list, &curr->elem, cmp_priority, NULL);
+	if (curr != idle_thread) {
+		ready_push (curr);
+		curr->ready_stamp = rdtsc ();
+	}
 	do_schedule (THREAD_READY);
 	intr_set_level (old_level);
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's priority to NEW_PRIORITY.
+   Ignored under the MLFQS, which computes priorities itself. */
 void
 thread_set_priority (int new_priority) {
-	/* Project 1 : alarm
-	struct thread *curr = thread_current();
-	enum intr_level old_level;
-
-	curr->original_priority = new_priority;
-
-	old_level = intr_disable();
-
-	if(list_empty(&curr->donations) || new_priority > curr->priority)
-		curr->priority = new_priority;
-
-	// thread_current ()->priority = new_priority;
-	struct thread *curr = thread_current();
-	enum intr_level old_level;
-
-	curr->priority = new_priority;
-	old_level = intr_disable();
+	if (thread_mlfqs)
+		return;
 
-	if(!list_empty(&ready_list)){
-		struct thread *front = list_entry(list_front(&ready_list), struct thread, elem);
-		if(curr->priority < front->priority){
-			thread_yield();
-		}
-	}
-	intr_set_level(old_level);*/
-  
 	/* Project 1 : Priority */
-	thread_current()->priority = new_priority;
-  thread_current()->original_priority = new_priority;
-  refresh_priority();
-	test_max_priority();
-  
-	intr_set_level(old_level);
+	enum intr_level old_level = intr_disable ();
+	thread_current ()->original_priority = new_priority;
+	refresh_priority ();
+	intr_set_level (old_level);
+
+	test_max_priority ();
 }
 
 /* Returns the current thread's priority. */
@@ -389,31 +454,46 @@ thread_get_priority (void) {
 	return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE, recomputes its
+   priority, and yields if it no longer has the highest priority. */
 void
-thread_set_nice (int nice UNUSED) {
-	/* TODO: Your implementation goes here */
+thread_set_nice (int nice) {
+	struct thread *curr = thread_current ();
+	enum intr_level old_level;
+
+	ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+	old_level = intr_disable ();
+	curr->nice = nice;
+	if (thread_mlfqs)
+		set_effective_priority (curr, mlfqs_priority (curr));
+	intr_set_level (old_level);
+
+	test_max_priority ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) {
-	/* TODO: Your implementation goes here */
-	return 0;
+	return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) {
-	/* TODO: Your implementation goes here */
-	return 0;
+	enum intr_level old_level = intr_disable ();
+	int load_avg_100 = fp_round (fp_mul_int (load_avg, 100));
+	intr_set_level (old_level);
+	return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) {
-	/* TODO: Your implementation goes here */
-	return 0;
+	enum intr_level old_level = intr_disable ();
+	int recent_cpu_100 = fp_round (fp_mul_int (thread_current ()->recent_cpu, 100));
+	intr_set_level (old_level);
+	return recent_cpu_100;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -435,8 +515,13 @@ idle (void *idle_started_ UNUSED) {
 	for (;;) {
 		/* Let someone else run. */
 		intr_disable ();
+		timer_idle_exit ();
 		thread_block ();
 
+		/* Nothing is runnable.  In tickless mode, skip the timer
+		   interrupts until the next sleeper is due. */
+		timer_idle_enter ();
+
 		/* Re-enable interrupts and wait for the next one.
 
 		   The `sti' instruction disables interrupts until the
@@ -468,6 +553,8 @@ kernel_thread (thread_func *function, void *aux) {
    NAME. */
 static void
 init_thread (struct thread *t, const char *name, int priority) {
+	enum intr_level old_level;
+
 	ASSERT (t != NULL);
 	ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
 	ASSERT (name != NULL);
@@ -480,7 +567,20 @@ init_thread (struct thread *t, const char *name, int priority) {
 	/* Project 1 : priority donation */
 	t->priority = t->original_priority = priority;
 	t->wait_lock = NULL;
-	list_init(&t->donations);
+	t->wait_rwlock = NULL;
+	heap_init(&t->held_locks, cmp_lock_priority, NULL);
+
+	/* Project 1 : mlfqs
+	 * 새 스레드는 부모의 nice, recent_cpu를 물려받는다 */
+	if (t == initial_thread) {
+		t->nice = NICE_DEFAULT;
+		t->recent_cpu = 0;
+	} else {
+		t->nice = thread_current ()->nice;
+		t->recent_cpu = thread_current ()->recent_cpu;
+	}
+	if (thread_mlfqs)
+		t->priority = t->original_priority = mlfqs_priority (t);
 
 	t->magic = THREAD_MAGIC;
 
@@ -491,6 +591,12 @@ init_thread (struct thread *t, const char *name, int priority) {
 	sema_init(&t->fork_sema, 0);
 	sema_init(&t->wait_sema, 0);
 	sema_init(&t->exit_sema, 0);
+
+	/* The timer interrupt walks ALL_LIST, so T joins it with
+	   interrupts off, once it is fully initialized. */
+	old_level = intr_disable ();
+	list_push_back (&all_list, &t->all_elem);
+	intr_set_level (old_level);
 }
 
 /* Chooses and returns the next thread to be scheduled.  Should
@@ -500,10 +606,77 @@ init_thread (struct thread *t, const char *name, int priority) {
    idle_thread. */
 static struct thread *
 next_thread_to_run (void) {
-	if (list_empty (&ready_list))
+	if (ready_mask == 0)
 		return idle_thread;
 	else
-		return list_entry (list_pop_front (&ready_list), struct thread, elem);
+		return ready_pop ();
+}
+
+/* Appends T to the tail of the ready queue for its priority. */
+static void
+ready_push (struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	list_push_back (&ready_queues[t->priority], &t->elem);
+	ready_mask |= 1ULL << t->priority;
+	ready_cnt++;
+}
+
+/* Removes T, which must be in THREAD_READY state, from its
+   ready queue. */
+static void
+ready_remove (struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (t->status == THREAD_READY);
+
+	list_remove (&t->elem);
+	if (list_empty (&ready_queues[t->priority]))
+		ready_mask &= ~(1ULL << t->priority);
+	ready_cnt--;
+}
+
+/* Removes and returns the oldest thread of the highest nonempty
+   priority level.  The ready queues must not be empty. */
+static struct thread *
+ready_pop (void) {
+	int priority = ready_max_priority ();
+	struct list *queue = &ready_queues[priority];
+	struct thread *t = list_entry (list_pop_front (queue), struct thread, elem);
+
+	if (list_empty (queue))
+		ready_mask &= ~(1ULL << priority);
+	ready_cnt--;
+	return t;
+}
+
+/* Returns the highest priority among the ready threads, or -1 if
+   no thread is ready. */
+static int
+ready_max_priority (void) {
+	if (ready_mask == 0)
+		return -1;
+	return 63 - __builtin_clzll (ready_mask);
+}
+
+/* Changes T's effective priority to PRIORITY.  A ready thread is
+   moved to the queue of its new level, at the tail as if it had
+   just become ready.  A thread waiting on a semaphore or
+   condition variable is likewise moved behind the waiters of its
+   new priority. */
+static void
+set_effective_priority (struct thread *t, int priority) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (t->priority == priority)
+		return;
+	if (t->status == THREAD_READY) {
+		ready_remove (t);
+		t->priority = priority;
+		ready_push (t);
+	} else {
+		t->priority = priority;
+		synch_priority_changed (t);
+	}
 }
 
 /* Use iretq to launch the thread */
@@ -639,6 +812,15 @@ schedule (void) {
 	ASSERT (intr_get_level () == INTR_OFF);
 	ASSERT (curr->status != THREAD_RUNNING);
 	ASSERT (is_thread (next));
+
+	/* Close CURR's slice and, unless NEXT is the idle thread,
+	   which never waits in the ready queues, its wait. */
+	uint64_t now = rdtsc ();
+	lat_record (&curr->slice_hist, &slice_hist, now - curr->run_stamp);
+	if (next != idle_thread)
+		lat_record (&next->wait_hist, &wait_hist, now - next->ready_stamp);
+	next->run_stamp = now;
+
 	/* Mark us as running. */
 	next->status = THREAD_RUNNING;
 
@@ -669,6 +851,83 @@ schedule (void) {
 	}
 }
 
+/* Project 1 : mlfqs */
+/* Returns T's priority under the MLFQS,
+   PRI_MAX - (recent_cpu / 4) - (nice * 2), clamped to the valid
+   range. */
+static int
+mlfqs_priority (const struct thread *t) {
+	int priority = PRI_MAX - fp_to_int (fp_div_int (t->recent_cpu, 4))
+		- t->nice * 2;
+
+	if (priority < PRI_MIN)
+		return PRI_MIN;
+	if (priority > PRI_MAX)
+		return PRI_MAX;
+	return priority;
+}
+
+/* Once-per-second MLFQS bookkeeping: updates the load average,
+   decays every thread's recent_cpu, and recomputes the
+   priorities that depend on it.  Runs in the timer interrupt, so
+   it only visits live non-idle threads through all_list. */
+static void
+mlfqs_update_second (void) {
+	struct list_elem *e;
+	fixed_t coeff;
+	int ready_threads = ready_cnt;
+
+	if (thread_current () != idle_thread)
+		ready_threads++;
+	load_avg = fp_add (fp_mul (fp_div_int (fp_from_int (59), 60), load_avg),
+			fp_mul_int (fp_div_int (fp_from_int (1), 60), ready_threads));
+
+	coeff = fp_div (fp_mul_int (load_avg, 2), fp_add_int (fp_mul_int (load_avg, 2), 1));
+	for (e = list_begin (&all_list); e != list_end (&all_list); e = list_next (e)) {
+		struct thread *t = list_entry (e, struct thread, all_elem);
+
+		if (t == idle_thread)
+			continue;
+		t->recent_cpu = fp_add_int (fp_mul (coeff, t->recent_cpu), t->nice);
+		set_effective_priority (t, mlfqs_priority (t));
+	}
+}
+
+/* Adds a sample of CYCLES to the per-thread histogram H and the
+   system-wide histogram ALL. */
+static void
+lat_record (struct lat_hist *h, struct lat_hist *all, uint64_t cycles) {
+	int bucket = 63 - __builtin_clzll (cycles | 1) - LAT_SHIFT;
+
+	if (bucket < 0)
+		bucket = 0;
+	else if (bucket >= LAT_BUCKETS)
+		bucket = LAT_BUCKETS - 1;
+	h->cnt[bucket]++;
+	all->cnt[bucket]++;
+}
+
+/* Prints the nonempty buckets of H on one line after LABEL, each
+   as "2^N:COUNT" where 2^N is the bucket's lower bound. */
+static void
+lat_print (const char *label, const struct lat_hist *h) {
+	bool empty = true;
+	int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++)
+		if (h->cnt[i] != 0)
+			empty = false;
+	if (empty)
+		return;
+
+	printf ("%s:", label);
+	for (i = 0; i < LAT_BUCKETS; i++)
+		if (h->cnt[i] != 0)
+			printf (" %s2^%d:%"PRIu32, i == 0 ? "<" : "",
+					i == 0 ? LAT_SHIFT + 1 : LAT_SHIFT + i, h->cnt[i]);
+	printf ("\n");
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t
 allocate_tid (void) {
@@ -692,59 +951,231 @@ cmp_priority(const struct list_elem *a, const struct list_elem *b, void *aux UNU
 	return t_a->priority > t_b->priority;
 }
 
+/* Project 1 - priority donation
+ * 각 락은 자신을 기다리는 스레드들을 우선순위 max-heap(waiters)으로,
+ * 각 스레드는 자신이 가진 락들을 "락의 최고 대기자 우선순위" 기준
+ * max-heap(held_locks)으로 관리한다.  스레드의 실제 우선순위는
+ * original_priority와 held_locks 루트 락의 우선순위 중 큰 값이므로
+ * 기부, 해제, 재계산 모두 O(log n)에 끝난다.
+ * rwlock은 holder가 여럿일 수 있으므로 스레드마다 최대 RWLOCK_HOLD_MAX개의
+ * rw_holds 슬롯으로 관리하고, 기부는 모든 holder에게 전달된다. */
+
+/* Maximum length of a donation chain that is followed. */
+#define DONATION_DEPTH 8
+
+/* Arrival counter for wait_seq, shared by locks and rwlocks. */
+static unsigned next_wait_seq;
+
+/* Orders threads in a lock's waiter heap: higher priority first,
+   then earlier arrival. */
+bool
+cmp_waiter_priority (const struct heap_elem *a, const struct heap_elem *b,
+		void *aux UNUSED) {
+	const struct thread *t_a = heap_entry (a, struct thread, wait_elem);
+	const struct thread *t_b = heap_entry (b, struct thread, wait_elem);
+
+	if (t_a->priority != t_b->priority)
+		return t_a->priority < t_b->priority;
+	return t_a->wait_seq > t_b->wait_seq;
+}
+
+/* Returns the priority LOCK donates to its holder: that of its
+   highest-priority waiter, or PRI_MIN - 1 if nobody waits. */
+static int
+lock_priority (const struct lock *lock) {
+	if (heap_empty (&lock->waiters))
+		return PRI_MIN - 1;
+	return heap_entry (heap_max (&lock->waiters), struct thread, wait_elem)->priority;
+}
+
+/* Returns the priority RW donates to each of its holders: that
+   of its highest-priority blocked reader or writer, or
+   PRI_MIN - 1 if nobody waits. */
+static int
+rwlock_priority (const struct rwlock *rw) {
+	int priority = PRI_MIN - 1;
+
+	if (!heap_empty (&rw->read_waiters))
+		priority = heap_entry (heap_max (&rw->read_waiters),
+				struct thread, wait_elem)->priority;
+	if (!heap_empty (&rw->write_waiters)) {
+		int writer = heap_entry (heap_max (&rw->write_waiters),
+				struct thread, wait_elem)->priority;
+		if (writer > priority)
+			priority = writer;
+	}
+	return priority;
+}
+
+/* Returns the heap of RW that blocked thread T waits in. */
+static struct heap *
+rwlock_wait_heap (struct thread *t) {
+	return t->wait_write ? &t->wait_rwlock->write_waiters
+		: &t->wait_rwlock->read_waiters;
+}
+
+/* Orders locks in a thread's held_locks heap by lock_priority(). */
+static bool
+cmp_lock_priority (const struct heap_elem *a, const struct heap_elem *b,
+		void *aux UNUSED) {
+	return lock_priority (heap_entry (a, struct lock, holder_elem))
+		< lock_priority (heap_entry (b, struct lock, holder_elem));
+}
+
+/* Returns T's priority including donations: the larger of its own
+   priority and the best priority donated through any lock or
+   rwlock it holds.  A rw_holds slot whose rwlock T is still
+   waiting for does not count. */
+static int
+effective_priority (const struct thread *t) {
+	int priority = t->original_priority;
+	int i;
+
+	if (!heap_empty (&t->held_locks)) {
+		int donated = lock_priority (heap_entry (heap_max (&t->held_locks),
+					struct lock, holder_elem));
+		if (donated > priority)
+			priority = donated;
+	}
+	for (i = 0; i < RWLOCK_HOLD_MAX; i++) {
+		const struct rwlock *rw = t->rw_holds[i].rwlock;
+
+		if (rw != NULL && rw != t->wait_rwlock) {
+			int donated = rwlock_priority (rw);
+			if (donated > priority)
+				priority = donated;
+		}
+	}
+	return priority;
+}
+
+/* Sets T's effective priority to PRIORITY.  If T is itself
+   waiting for a lock, T is re-keyed in that lock's waiter heap
+   and the lock in its holder's held_locks, since both orders
+   depend on T's priority.  Likewise if T waits for an rwlock. */
+static void
+change_donated_priority (struct thread *t, int priority) {
+	struct lock *lock = t->wait_lock;
+	struct thread *holder = lock != NULL ? lock->holder : NULL;
+
+	if (lock != NULL) {
+		if (holder != NULL)
+			heap_remove (&holder->held_locks, &lock->holder_elem);
+		heap_remove (&lock->waiters, &t->wait_elem);
+	} else if (t->wait_rwlock != NULL)
+		heap_remove (rwlock_wait_heap (t), &t->wait_elem);
+	set_effective_priority (t, priority);
+	if (lock != NULL) {
+		heap_push (&lock->waiters, &t->wait_elem);
+		if (holder != NULL)
+			heap_push (&holder->held_locks, &lock->holder_elem);
+	} else if (t->wait_rwlock != NULL)
+		heap_push (rwlock_wait_heap (t), &t->wait_elem);
+}
+
+/* Recomputes the priority of T after one of the locks or
+   rwlocks it holds gained a waiter, and keeps following the
+   chain while it changes. */
+static void
+donate_to (struct thread *t, int depth) {
+	int priority = effective_priority (t);
+
+	if (priority != t->priority) {
+		change_donated_priority (t, priority);
+		donate_from (t, depth + 1);
+	}
+}
+
+/* Propagates T's priority to whoever holds the lock or rwlock T
+   waits for.  An rwlock may have several readers, each of which
+   gets the donation. */
+static void
+donate_from (struct thread *t, int depth) {
+	struct list_elem *e;
+
+	if (depth >= DONATION_DEPTH)
+		return;
+	if (t->wait_lock != NULL) {
+		if (t->wait_lock->holder != NULL)
+			donate_to (t->wait_lock->holder, depth);
+	} else if (t->wait_rwlock != NULL) {
+		for (e = list_begin (&t->wait_rwlock->holders);
+				e != list_end (&t->wait_rwlock->holders); e = list_next (e)) {
+			struct rwlock_hold *hold = list_entry (e, struct rwlock_hold, elem);
+			donate_to (hold->thread, depth);
+		}
+	}
+}
+
 /* Priority Donate :
- * - 락을 대기하고 있는 인자가 있는 경우, 락을 가지고 있는 스레드에게 우선순위를 기부한다
- * - Nested donation의 경우 재귀 호출의 깊이를 제한한다. 무한 루프 발생 방지. */
+ * - 현재 스레드가 기다리는 락(또는 rwlock)의 holder부터 체인을 따라 우선순위를 갱신한다
+ * - 우선순위가 더 이상 바뀌지 않거나 DONATION_DEPTH에 도달하면 멈춘다. */
 void
 donate_priority (void){
-	int depth;
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	donate_from(thread_current(), 0);
+}
+
+/* Add to Waiters Heap :
+ * - 현재 스레드를 LOCK의 waiters heap에 넣고 holder에게 우선순위를 기부한다. */
+void
+donation_add (struct lock *lock){
 	struct thread *curr = thread_current();
-	int priority = curr->priority;
-
-	for(depth = 0; depth < 8; depth++){
-		if(!curr->wait_lock)
-			break;
-		struct thread *holder = curr->wait_lock->holder;
-		if(holder->priority < priority){
-			holder->priority = priority;
-		}
-		curr = holder;
-	}
+	struct thread *holder = lock->holder;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (holder != NULL);
+
+	curr->wait_lock = lock;
+	curr->wait_seq = next_wait_seq++;
+	heap_remove(&holder->held_locks, &lock->holder_elem);
+	heap_push(&lock->waiters, &curr->wait_elem);
+	heap_push(&holder->held_locks, &lock->holder_elem);
+	donate_priority();
 }
 
-/* Delete thread from Waiters List : 
- * - 락을 해지한 후 waiters 리스트에서 스레드를 삭제한다. 
- * - 리스트를 확인하여 해지할 lock을 보유하고 있는 스레드를 찾아 삭제한다. */
+/* Add to rwlock Waiters Heap :
+ * - 현재 스레드를 RW의 reader 또는 writer waiters heap에 넣고
+ *   모든 holder에게 우선순위를 기부한다. */
 void
-remove_with_lock (struct lock *lock){
+donation_add_rwlock (struct rwlock *rw, bool write){
 	struct thread *curr = thread_current();
-	struct list_elem *e;
 
-	for(e = list_begin(&curr->donations); e != list_end(&curr->donations); e = list_next(e)){
-		struct thread *t = list_entry(e, struct thread, donation_elem);
-		if(t->wait_lock == lock)
-			list_remove(&t->donation_elem);
-	}
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	curr->wait_rwlock = rw;
+	curr->wait_write = write;
+	curr->wait_seq = next_wait_seq++;
+	heap_push(rwlock_wait_heap(curr), &curr->wait_elem);
+	if(!thread_mlfqs)
+		donate_priority();
 }
 
-/* Priority Refresh :
- * - 우선순위를 원래대로 복구하거나
- * - 아직 기부자 리스트가 남아있다면, 그 중 가장 높은 우선순위로 재설정한다. */
+/* Delete from Held Locks :
+ * - 해제할 LOCK을 현재 스레드의 held_locks에서 빼고 우선순위를 재계산한다.
+ * - LOCK의 대기자들은 waiters heap에 그대로 남아 다음 holder에게 기부한다. */
 void
-refresh_priority(void){
-	struct thread *t = thread_current();
-	t->priority = t->original_priority;
+donation_remove (struct lock *lock){
+	ASSERT (intr_get_level () == INTR_OFF);
 
-	if(list_empty(&t->donations))
-		return;
-	list_sort(&t->donations, cmp_priority, 0);
+	heap_remove(&thread_current()->held_locks, &lock->holder_elem);
+	refresh_priority();
+}
 
-	struct list_elem *max_elem = list_front(&t->donations);
-	struct thread *max_thread = list_entry(max_elem, struct thread, donation_elem);
+/* Priority Refresh :
+ * - 원래 우선순위와 held_locks 중 가장 높은 기부 우선순위 중 큰 값으로 재설정한다. */
+void
+refresh_priority(void){
+	thread_refresh_priority(thread_current());
+}
 
-	if(t->priority < max_thread->priority){
-		t->priority = max_thread->priority;
-	}
+/* Recomputes T's priority from its own priority and the
+   donations it currently receives. */
+void
+thread_refresh_priority (struct thread *t){
+	if(!thread_mlfqs)
+		set_effective_priority(t, effective_priority(t));
 }
 
 /* Priority yield :
@@ -752,14 +1183,9 @@ refresh_priority(void){
  * - 즉시 양보 (yield) 하도록 한다. */
 void
 test_max_priority(void){
-	if(list_empty(&ready_list))
-		return;
-	struct thread *curr = thread_current();
-	struct thread *t = list_entry(list_front(&ready_list), struct thread, elem);
 	enum intr_level old_level = intr_disable();
-	if((!intr_context()) && (curr->priority < t->priority)){
+	if((!intr_context()) && (thread_current()->priority < ready_max_priority())){
 		thread_yield();
 	}
 	intr_set_level(old_level);
-
-}
\ No newline at end of file
+}
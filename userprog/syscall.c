@@ -20,9 +20,6 @@
 void syscall_entry (void);
 void syscall_handler (struct intr_frame *);
 
-/* Project 2 : system call - write, read */
-struct lock filesys_lock;
-
 /* System call.
  *
  * Previously system call services was handled by the interrupt handler
@@ -47,9 +44,6 @@ syscall_init (void) {
 	 * mode stack. Therefore, we masked the FLAG_FL. */
 	write_msr(MSR_SYSCALL_MASK,
 			FLAG_IF | FLAG_TF | FLAG_DF | FLAG_IOPL | FLAG_AC | FLAG_NT);
-	
-	/* Project 2 : system call */
-	lock_init(&filesys_lock);
 }
 
 /* The main system call interface */
@@ -211,9 +205,8 @@ int read (int fd, void *buffer, unsigned length){
 	if (file == NULL)
 		return -1;
 	
-	lock_acquire(&filesys_lock);
+	/* The file system does its own locking, per inode. */
 	off_t bytes_read = file_read(file, buffer, length);
-	lock_release(&filesys_lock);
 
 	return bytes_read;
 }
@@ -235,10 +228,7 @@ int write (int fd, const void *buffer, unsigned length){
 	if (file == NULL)
 		return -1;
 
-	off_t bytes_write = -1;
-	lock_acquire(&filesys_lock);
-	bytes_write = file_write(file, buffer, length);
-	lock_release(&filesys_lock);
+	off_t bytes_write = file_write(file, buffer, length);
 
 	return bytes_write;
 }